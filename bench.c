@@ -0,0 +1,177 @@
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+//
+#include "field.h"
+#include "linebatch.h"
+#include "morton.h"
+#include "pool.h"
+#include "profiler.h"
+#include "sim.h"
+
+// Headless benchmark: runs the sim at a fixed dt and reports throughput.
+// usage: ./bench-sim [frames] [dt] [threads]
+//    (or: make bench bench_args="frames dt threads")
+// without a thread count, field evaluation is swept from 1 thread up to one
+// per cpu to report scaling. CUBE_TRAVERSAL=box evaluates whole bullet
+// bounding boxes instead of just the octahedron, for comparison.
+// CUBE_BULLETS sizes the bullet pool and CUBE_SPAWN_SCALE scales the spawn
+// delay, e.g. CUBE_BULLETS=20000 CUBE_SPAWN_SCALE=0.001 for a load test.
+// CUBE_GRID=N or CUBE_GRID=XxYxZ resizes the grid (default 25 per side).
+// CUBE_EMIT=instances emits one CubeInstance per lit cube (the instanced
+// renderer) instead of 24 line vertices.
+// CUBE_ORDER=linear stores the field row-major instead of in Morton order.
+// misses/frame counts hardware cache misses in this process (all threads)
+// and shows "-" where perf counters aren't available, e.g. most VMs.
+// CUBE_RECORD=path writes every spawn to a spawn trace (spawntrace.h) and
+// CUBE_REPLAY=path replays one, to compare kernels and builds on exactly the
+// same workload. the main binary takes both too.
+// CUBE_TRACE=path profiles every frame and writes the last PROF_FRAMES of
+// the last run there as a Chrome trace.
+
+#define DEFAULT_FRAMES 20000
+#define DEFAULT_DT (1.0f / 60.0f)
+
+typedef struct BenchResult {
+    double elapsed;
+    uint64_t bullet_frames, cube_evals, cubes_lit;
+    int64_t cache_misses; // -1 if unavailable
+} BenchResult;
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// hardware cache misses of this process, inherited by the pool's threads
+// since they're created after. returns -1 if perf counters are unavailable
+static int open_miss_counter() {
+    struct perf_event_attr attr = {
+        .size = sizeof(attr),
+        .type = PERF_TYPE_HARDWARE,
+        .config = PERF_COUNT_HW_CACHE_MISSES,
+        .disabled = 1,
+        .inherit = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static BenchResult run(long frames, float dt, int threads) {
+    static Sim sim;
+    sim_init(&sim, grid_init(0, 0, 0), 0);
+    const char *traversal = getenv("CUBE_TRAVERSAL");
+    sim.full_box = traversal && strcmp(traversal, "box") == 0;
+    const char *emit = getenv("CUBE_EMIT");
+    int instanced = emit && strcmp(emit, "instances") == 0;
+    int misses = open_miss_counter();
+    const char *trace = getenv("CUBE_TRACE");
+    Profiler *prof = trace ? prof_create("bench", 1) : NULL;
+    prof_bind(prof);
+    FieldPool *pool = pool_create(threads);
+    LineBatch batch = {0};
+    InstanceBatch instances = {.grid = &sim.grid};
+
+    BenchResult res = {.cache_misses = -1};
+    if (misses >= 0)
+        ioctl(misses, PERF_EVENT_IOC_ENABLE, 0);
+    uint64_t start = now_ns();
+    for (long f = 0; f < frames; f++) {
+        prof_frame_begin();
+        sim_step(&sim, dt);
+        prof_begin(PROF_FIELD);
+        res.cube_evals += pool_eval(pool, &sim);
+        res.cubes_lit += pool_hit_count(pool);
+        prof_end(PROF_FIELD);
+        // vertex emission, everything the cpu renderer does short of the GL
+        prof_begin(PROF_EMIT);
+        if (instanced) {
+            instance_batch_clear(&instances);
+            pool_for_each_hit(pool, instance_batch_push_cube, &instances);
+        } else {
+            line_batch_clear(&batch);
+            pool_for_each_hit(pool, line_batch_push_cube, &batch);
+        }
+        prof_end(PROF_EMIT);
+        prof_frame_end();
+        res.bullet_frames += sim.bullet_count;
+    }
+    res.elapsed = (double)(now_ns() - start) / 1e9;
+    if (misses >= 0) {
+        ioctl(misses, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(misses, &res.cache_misses, sizeof(res.cache_misses)) !=
+            sizeof(res.cache_misses))
+            res.cache_misses = -1;
+        close(misses);
+    }
+    if (prof) {
+        prof_write_trace(&prof, 1, trace);
+        prof_destroy(prof);
+    }
+    line_batch_free(&batch);
+    instance_batch_free(&instances);
+    pool_destroy(pool);
+    sim_free(&sim);
+    return res;
+}
+
+static void report(long frames, int threads, BenchResult res, double base) {
+    char misses[32] = "-";
+    if (res.cache_misses >= 0)
+        snprintf(misses, sizeof(misses), "%.1f",
+                 (double)res.cache_misses / (double)frames);
+    printf("%7d %9.3f %11.1f %12.3e %14.3e %12.1f %10.1f %13s %8.2fx\n",
+           threads, res.elapsed, res.elapsed * 1e9 / (double)frames,
+           (double)res.bullet_frames / res.elapsed,
+           (double)res.cube_evals / res.elapsed,
+           (double)res.cube_evals / (double)frames,
+           (double)res.cubes_lit / (double)frames, misses,
+           base / res.elapsed);
+}
+
+int main(int argc, char **argv) {
+    long frames = argc > 1 ? atol(argv[1]) : DEFAULT_FRAMES;
+    float dt = argc > 2 ? (float)atof(argv[2]) : DEFAULT_DT;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    if (frames <= 0 || dt <= 0.0f || threads < 0) {
+        fprintf(stderr, "usage: %s [frames] [dt] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    field_init();
+    morton_init();
+    Grid grid = grid_init(0, 0, 0);
+    printf("frames: %ld (dt %.4f s, grid %dx%dx%d, kernel %s, order %s/%s)\n",
+           frames, dt, grid.nx, grid.ny, grid.nz, field_kernel_name(),
+           brick_order_name(brick_order_from_env()), morton_impl_name());
+    printf("%7s %9s %11s %12s %14s %12s %10s %13s %9s\n", "threads",
+           "elapsed", "ns/frame", "bullets/sec", "cube evals/sec",
+           "evals/frame", "lit/frame", "misses/frame", "speedup");
+
+    if (threads > 0) {
+        BenchResult res = run(frames, dt, threads);
+        report(frames, threads, res, res.elapsed);
+        return 0;
+    }
+
+    // 1, 2, 4, ... and finally every cpu
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0.0;
+    for (int t = 1;; t = t * 2 < cpus ? t * 2 : cpus) {
+        BenchResult res = run(frames, dt, t);
+        if (t == 1)
+            base = res.elapsed;
+        report(frames, t, res, base);
+        if (t >= cpus)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "bins.h"
+#include "morton.h"
+
+#define BIN_INDEX_MIN_CAP 1024
+
+static void *alloc_or_die(void *ptr, size_t size, const char *what) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        fprintf(stderr, "out of memory allocating %s\n", what);
+        exit(1);
+    }
+    return ptr;
+}
+
+void bins_init(BulletBins *bins, const Grid *grid) {
+    *bins = (BulletBins){
+        .bx = (grid->nx + BIN_BRICK - 1) / BIN_BRICK,
+        .by = (grid->ny + BIN_BRICK - 1) / BIN_BRICK,
+        .bz = (grid->nz + BIN_BRICK - 1) / BIN_BRICK,
+    };
+    int bricks = bins_brick_count(bins);
+    bins->offsets =
+        alloc_or_die(NULL, (bricks + 1) * sizeof(int), "bin offsets");
+    bins->active = alloc_or_die(NULL, bricks * sizeof(int), "bin bricks");
+
+    // touched bricks are tracked by Morton code so collecting them walks
+    // Z-order
+    morton_init();
+    int bx = bins->bx, by = bins->by, bz = bins->bz;
+    int side = morton_side(bx > by ? (bx > bz ? bx : bz) : (by > bz ? by : bz));
+    bins->touched_slots = side * side * side;
+    bins->touched = calloc((bins->touched_slots + 63) / 64, sizeof(uint64_t));
+    bins->morton_x =
+        alloc_or_die(NULL, (bx + by + bz) * sizeof(uint32_t), "bin bricks");
+    if (!bins->touched) {
+        fprintf(stderr, "out of memory allocating bin bricks\n");
+        exit(1);
+    }
+    bins->morton_y = bins->morton_x + bx;
+    bins->morton_z = bins->morton_y + by;
+    morton_axis_table(bins->morton_x, bx, 0);
+    morton_axis_table(bins->morton_y, by, 1);
+    morton_axis_table(bins->morton_z, bz, 2);
+}
+
+void bins_free(BulletBins *bins) {
+    free(bins->offsets);
+    free(bins->indices);
+    free(bins->boxes);
+    free(bins->active);
+    free(bins->touched);
+    free(bins->morton_x);
+    *bins = (BulletBins){0};
+}
+
+// two passes over the bullets: count per brick, prefix sum, then scatter.
+// `offsets` doubles as the write cursor and ends up shifted by one brick,
+// which the final shift puts back
+void bins_build(BulletBins *bins, const Sim *sim) {
+    const Bullets *bullets = &sim->bullets;
+    int bricks = bins_brick_count(bins);
+    if (bullets->live_count > bins->boxes_cap) {
+        bins->boxes_cap = bullets->cap;
+        bins->boxes = alloc_or_die(bins->boxes,
+                                   bins->boxes_cap * sizeof(BulletBox),
+                                   "bin boxes");
+    }
+
+    memset(bins->offsets, 0, (bricks + 1) * sizeof(int));
+    int total = 0;
+    for (int k = 0; k < bullets->live_count; k++) {
+        int i = bullets->live[k];
+        BulletBox box = (BulletBox){0};
+        if (is_in_grid(bullets, i))
+            box = get_bullet_bounding_box(&sim->grid,
+                                          bullet_cached_pos(bullets, i),
+                                          bullet_scale(bullets, i));
+        if (box.max_x <= box.min_x || box.max_y <= box.min_y ||
+            box.max_z <= box.min_z) {
+            bins->boxes[k] = (BulletBox){0};
+            continue;
+        }
+        // cell range [min, max) -> inclusive-exclusive brick range
+        box = (BulletBox){
+            box.min_x / BIN_BRICK, (box.max_x - 1) / BIN_BRICK + 1,
+            box.min_y / BIN_BRICK, (box.max_y - 1) / BIN_BRICK + 1,
+            box.min_z / BIN_BRICK, (box.max_z - 1) / BIN_BRICK + 1,
+        };
+        bins->boxes[k] = box;
+        for (int z = box.min_z; z < box.max_z; z++)
+            for (int y = box.min_y; y < box.max_y; y++)
+                for (int x = box.min_x; x < box.max_x; x++) {
+                    bins->offsets[(z * bins->by + y) * bins->bx + x]++;
+                    uint32_t m = bins->morton_x[x] + bins->morton_y[y] +
+                                 bins->morton_z[z];
+                    bins->touched[m >> 6] |= 1ull << (m & 63);
+                }
+        total += (box.max_x - box.min_x) * (box.max_y - box.min_y) *
+                 (box.max_z - box.min_z);
+    }
+
+    if (total > bins->index_cap) {
+        int cap = bins->index_cap ? bins->index_cap : BIN_INDEX_MIN_CAP;
+        while (cap < total)
+            cap *= 2;
+        bins->indices =
+            alloc_or_die(bins->indices, cap * sizeof(int), "bin indices");
+        bins->index_cap = cap;
+    }
+    bins->index_count = total;
+
+    // collect the touched bricks in Z-order, leaving the bitset cleared
+    bins->active_count = 0;
+    for (int w = 0; w < (bins->touched_slots + 63) / 64; w++) {
+        for (uint64_t bits = bins->touched[w]; bits; bits &= bits - 1) {
+            uint32_t x, y, z;
+            morton_decode(w * 64 + __builtin_ctzll(bits), &x, &y, &z);
+            bins->active[bins->active_count++] =
+                ((int)z * bins->by + (int)y) * bins->bx + (int)x;
+        }
+        bins->touched[w] = 0;
+    }
+
+    // exclusive prefix sum, offsets[b] = start of brick b
+    int sum = 0;
+    for (int b = 0; b <= bricks; b++) {
+        int count = bins->offsets[b];
+        bins->offsets[b] = sum;
+        sum += count;
+    }
+    for (int k = 0; k < bullets->live_count; k++) {
+        BulletBox box = bins->boxes[k];
+        for (int z = box.min_z; z < box.max_z; z++)
+            for (int y = box.min_y; y < box.max_y; y++)
+                for (int x = box.min_x; x < box.max_x; x++) {
+                    int b = (z * bins->by + y) * bins->bx + x;
+                    bins->indices[bins->offsets[b]++] = k;
+                }
+    }
+    // every brick's cursor now sits at the next brick's start
+    memmove(bins->offsets + 1, bins->offsets, bricks * sizeof(int));
+    bins->offsets[0] = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef BINS_H
+#define BINS_H
+
+#include "brickmap.h"
+#include "sim.h"
+
+// Coarse per-brick bullet lists for the shader-side field (cubegrid.vs).
+//
+// The grid is cut into BIN_BRICK^3 bricks and every live bullet is appended
+// to each brick its bounding box overlaps, so a cube only tests the bullets
+// listed for its own brick instead of all of them (clustered light culling,
+// with bullets as the lights). The lists are stored CSR style: brick b owns
+// indices[offsets[b] .. offsets[b + 1]). An index is the bullet's position in
+// the live list, which is the order the bullet table is packed in.
+//
+// Bricks are the BrickMap's. `active` lists the bricks with at least one
+// bullet in Z-order (see morton.h), so the compute field only dispatches
+// those, neighbourhood by neighbourhood.
+
+#define BIN_BRICK BRICK_SIZE
+
+typedef struct BulletBins {
+    int bx, by, bz; // bricks per axis
+    int *offsets;   // brick count + 1
+    int *indices;
+    int index_count, index_cap;
+    BulletBox *boxes; // per live bullet, in bricks
+    int boxes_cap;
+    uint64_t *touched; // one bit per Morton code, scratch for `active`
+    int touched_slots;
+    uint32_t *morton_x, *morton_y, *morton_z; // per-axis brick codes
+    int *active;
+    int active_count;
+} BulletBins;
+
+void bins_init(BulletBins *bins, const Grid *grid);
+void bins_free(BulletBins *bins);
+
+// rebuilds every list from the live bullets
+void bins_build(BulletBins *bins, const Sim *sim);
+
+static inline int bins_brick_count(const BulletBins *bins) {
+    return bins->bx * bins->by * bins->bz;
+}
+
+#endif // BINS_H
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "brickmap.h"
+#include "morton.h"
+
+#define BRICK_PAGE_MIN_CAP 64
+
+BrickOrder brick_order_from_env() {
+    const char *env = getenv("CUBE_ORDER");
+    return env && strcmp(env, "linear") == 0 ? BRICK_ORDER_LINEAR
+                                             : BRICK_ORDER_MORTON;
+}
+
+const char *brick_order_name(BrickOrder order) {
+    return order == BRICK_ORDER_MORTON ? "morton" : "linear";
+}
+
+void brick_map_init(BrickMap *map, const Grid *grid, BrickOrder order) {
+    morton_init();
+    *map = (BrickMap){
+        .bx = (grid->nx + BRICK_SIZE - 1) / BRICK_SIZE,
+        .by = (grid->ny + BRICK_SIZE - 1) / BRICK_SIZE,
+        .bz = (grid->nz + BRICK_SIZE - 1) / BRICK_SIZE,
+        .order = order,
+    };
+    int bx = map->bx, by = map->by, bz = map->bz;
+    map->brick_x = malloc((bx + by + bz) * sizeof(uint32_t));
+    if (!map->brick_x) {
+        fprintf(stderr, "out of memory allocating brick map\n");
+        exit(1);
+    }
+    map->brick_y = map->brick_x + bx;
+    map->brick_z = map->brick_y + by;
+
+    uint32_t cells[3][BRICK_SIZE];
+    if (order == BRICK_ORDER_MORTON) {
+        int side = morton_side(bx > by ? (bx > bz ? bx : bz)
+                                       : (by > bz ? by : bz));
+        map->slots = side * side * side;
+        morton_axis_table(map->brick_x, bx, 0);
+        morton_axis_table(map->brick_y, by, 1);
+        morton_axis_table(map->brick_z, bz, 2);
+        for (int axis = 0; axis < 3; axis++)
+            morton_axis_table(cells[axis], BRICK_SIZE, axis);
+    } else {
+        map->slots = bx * by * bz;
+        for (int i = 0; i < bx; i++)
+            map->brick_x[i] = i;
+        for (int i = 0; i < by; i++)
+            map->brick_y[i] = i * bx;
+        for (int i = 0; i < bz; i++)
+            map->brick_z[i] = i * bx * by;
+        for (int i = 0; i < BRICK_SIZE; i++) {
+            cells[0][i] = i;
+            cells[1][i] = i * BRICK_SIZE;
+            cells[2][i] = i * BRICK_SIZE * BRICK_SIZE;
+        }
+    }
+    for (int i = 0; i < BRICK_SIZE; i++) {
+        map->cell_x[i] = (uint16_t)cells[0][i];
+        map->cell_y[i] = (uint16_t)cells[1][i];
+        map->cell_z[i] = (uint16_t)cells[2][i];
+    }
+    for (int z = 0; z < BRICK_SIZE; z++)
+        for (int y = 0; y < BRICK_SIZE; y++)
+            for (int x = 0; x < BRICK_SIZE; x++) {
+                uint8_t *local = map->cell_local[brick_cell(map, x, y, z)];
+                local[0] = (uint8_t)x;
+                local[1] = (uint8_t)y;
+                local[2] = (uint8_t)z;
+            }
+
+    map->active = calloc((map->slots + 63) / 64, sizeof(uint64_t));
+    map->page_of = malloc(map->slots * sizeof(int));
+    if (!map->active || !map->page_of) {
+        fprintf(stderr, "out of memory allocating brick map\n");
+        exit(1);
+    }
+}
+
+void brick_map_free(BrickMap *map) {
+    free(map->brick_x);
+    free(map->active);
+    free(map->page_of);
+    free(map->pages);
+    *map = (BrickMap){0};
+}
+
+void brick_map_clear(BrickMap *map) {
+    memset(map->active, 0, (map->slots + 63) / 64 * sizeof(uint64_t));
+    map->page_count = 0;
+}
+
+void brick_map_mark_box(BrickMap *map, BulletBox box) {
+    if (box.max_x <= box.min_x || box.max_y <= box.min_y ||
+        box.max_z <= box.min_z)
+        return;
+    int x1 = (box.max_x - 1) / BRICK_SIZE, y1 = (box.max_y - 1) / BRICK_SIZE,
+        z1 = (box.max_z - 1) / BRICK_SIZE;
+    for (int z = box.min_z / BRICK_SIZE; z <= z1; z++)
+        for (int y = box.min_y / BRICK_SIZE; y <= y1; y++)
+            for (int x = box.min_x / BRICK_SIZE; x <= x1; x++) {
+                uint32_t b =
+                    map->brick_x[x] + map->brick_y[y] + map->brick_z[z];
+                map->active[b >> 6] |= 1ull << (b & 63);
+            }
+}
+
+void brick_map_commit(BrickMap *map) {
+    int count = 0;
+    int words = (map->slots + 63) / 64;
+    for (int w = 0; w < words; w++)
+        count += __builtin_popcountll(map->active[w]);
+    if (count > map->page_cap) {
+        int cap = map->page_cap ? map->page_cap : BRICK_PAGE_MIN_CAP;
+        while (cap < count)
+            cap *= 2;
+        BrickPage *pages = realloc(map->pages, cap * sizeof(BrickPage));
+        if (!pages) {
+            fprintf(stderr, "out of memory growing brick map\n");
+            exit(1);
+        }
+        map->pages = pages;
+        map->page_cap = cap;
+    }
+    // only the masks, cells are initialized when their bit is first set
+    map->page_count = 0;
+    for (int w = 0; w < words; w++) {
+        for (uint64_t bits = map->active[w]; bits; bits &= bits - 1) {
+            int b = w * 64 + __builtin_ctzll(bits);
+            memset(map->pages[map->page_count].mask, 0,
+                   sizeof(map->pages[0].mask));
+            map->page_of[b] = map->page_count++;
+        }
+    }
+}
+
+int brick_map_count(const BrickMap *map) {
+    int count = 0;
+    for (int p = 0; p < map->page_count; p++)
+        for (int w = 0; w < BRICK_MASK_WORDS; w++)
+            count += __builtin_popcountll(map->pages[p].mask[w]);
+    return count;
+}
+
+// first cell of brick `b`
+static void brick_origin(const BrickMap *map, int b, int *x, int *y,
+                         int *z) {
+    if (map->order == BRICK_ORDER_MORTON) {
+        uint32_t bx, by, bz;
+        morton_decode((uint32_t)b, &bx, &by, &bz);
+        *x = (int)bx, *y = (int)by, *z = (int)bz;
+    } else {
+        *x = b % map->bx;
+        *y = b / map->bx % map->by;
+        *z = b / (map->bx * map->by);
+    }
+    *x *= BRICK_SIZE;
+    *y *= BRICK_SIZE;
+    *z *= BRICK_SIZE;
+}
+
+void brick_map_for_each(const BrickMap *map, const Grid *grid,
+                        CubeEmitFn emit, void *user) {
+    int words = (map->slots + 63) / 64;
+    for (int w = 0; w < words; w++) {
+        for (uint64_t bricks = map->active[w]; bricks;
+             bricks &= bricks - 1) {
+            int b = w * 64 + __builtin_ctzll(bricks);
+            const BrickPage *page = brick_page(map, b);
+            int x0, y0, z0;
+            brick_origin(map, b, &x0, &y0, &z0);
+            for (int m = 0; m < BRICK_MASK_WORDS; m++) {
+                for (uint64_t cells = page->mask[m]; cells;
+                     cells &= cells - 1) {
+                    int c = m * 64 + __builtin_ctzll(cells);
+                    const uint8_t *local = map->cell_local[c];
+                    int x = x0 + local[0], y = y0 + local[1],
+                        z = z0 + local[2];
+                    emit(user, grid_idx(grid, x, y, z),
+                         grid_cube_pos(grid, x, y, z), page->side_len[c],
+                         page->color[c]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef BRICKMAP_H
+#define BRICKMAP_H
+
+#include <stdint.h>
+//
+#include "sim.h"
+
+// Two-level sparse occupancy for large grids.
+//
+// The grid is cut into BRICK_SIZE^3 bricks. A top-level bitset marks the
+// active bricks, and every active brick owns a page with a 512-bit occupancy
+// mask plus the side length and color of each of its cells. Everything that
+// walks the map skips a clear bitset word (64 bricks) or mask word (64 cells)
+// at once and finds set bits with ctz, so a walk costs the active cells, not
+// the grid volume.
+//
+// Bricks and the cells inside a page are either in Morton order (the default,
+// see morton.h) or row-major (CUBE_ORDER=linear). Under Morton order a walk
+// visits bricks in Z-order, pages are handed out in that order, and each
+// mask word is a 4x4x4 block of the brick. Row-major makes a mask word one
+// z-layer of the brick. Either way a word never spans more than 4 z-layers,
+// 4-aligned, so writers that own disjoint 4-aligned z-ranges (FieldPool's
+// slabs) can fill the same page without synchronizing.
+//
+// Bricks are marked first and committed in one go, which is serial. Cells
+// are only written after that.
+
+#define BRICK_SIZE 8
+#define BRICK_CELLS (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+#define BRICK_MASK_WORDS (BRICK_CELLS / 64)
+// z-layers a mask word may span, slabs must be multiples of this
+#define BRICK_WORD_Z 4
+
+typedef enum BrickOrder {
+    BRICK_ORDER_MORTON,
+    BRICK_ORDER_LINEAR,
+} BrickOrder;
+
+typedef struct BrickPage {
+    uint64_t mask[BRICK_MASK_WORDS];
+    float side_len[BRICK_CELLS];
+    Vector4 color[BRICK_CELLS];
+} BrickPage;
+
+// a brick's index is brick_x[bx] + brick_y[by] + brick_z[bz] and a cell's
+// index in its page cell_x[lx] + cell_y[ly] + cell_z[lz], the tables decide
+// the order
+typedef struct BrickMap {
+    int bx, by, bz; // bricks per axis
+    BrickOrder order;
+    int slots;         // brick index space, bigger than bx * by * bz under
+                       // Morton order when the axes aren't equal powers of 2
+    uint32_t *brick_x; // bx + by + bz entries, brick_y/brick_z point inside
+    uint32_t *brick_y, *brick_z;
+    uint16_t cell_x[BRICK_SIZE], cell_y[BRICK_SIZE], cell_z[BRICK_SIZE];
+    uint8_t cell_local[BRICK_CELLS][3]; // page cell -> x, y, z in the brick
+    uint64_t *active; // one bit per brick slot
+    int *page_of;     // brick -> page, only valid while active
+    BrickPage *pages;
+    int page_count, page_cap;
+} BrickMap;
+
+// order BRICK_ORDER_MORTON unless CUBE_ORDER=linear is set
+BrickOrder brick_order_from_env();
+const char *brick_order_name(BrickOrder order);
+
+void brick_map_init(BrickMap *map, const Grid *grid, BrickOrder order);
+void brick_map_free(BrickMap *map);
+
+// deactivates every brick
+void brick_map_clear(BrickMap *map);
+
+// marks every brick overlapping the cells of `box` as active
+void brick_map_mark_box(BrickMap *map, BulletBox box);
+
+// hands every active brick an empty page, in walk order. may move the pages,
+// so not while anyone holds one
+void brick_map_commit(BrickMap *map);
+
+// lit cells over every active page
+int brick_map_count(const BrickMap *map);
+
+// emits every set cell, brick by brick in walk order
+void brick_map_for_each(const BrickMap *map, const Grid *grid,
+                        CubeEmitFn emit, void *user);
+
+static inline int brick_of(const BrickMap *map, int x, int y, int z) {
+    return (int)(map->brick_x[x / BRICK_SIZE] + map->brick_y[y / BRICK_SIZE] +
+                 map->brick_z[z / BRICK_SIZE]);
+}
+
+static inline int brick_cell(const BrickMap *map, int x, int y, int z) {
+    return map->cell_x[x % BRICK_SIZE] + map->cell_y[y % BRICK_SIZE] +
+           map->cell_z[z % BRICK_SIZE];
+}
+
+// the page of an active brick
+static inline BrickPage *brick_page(const BrickMap *map, int brick) {
+    return &map->pages[map->page_of[brick]];
+}
+
+#endif // BRICKMAP_H
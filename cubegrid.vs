@@ -1,45 +1,93 @@
 #version 300 es
 precision highp float;
 
-in vec3 vertexPosition;
-in vec2 vertexTexCoord;
-in vec3 vertexNormal;
-
-// Instance transform (raylib provides this with DrawMeshInstanced)
-in mat4 instanceTransform;
+// drawn instanced over the whole grid with the same cube outline as
+// linecube.vs, one instance per cube. the cube center comes from the instance
+// index, x fastest (see grid_idx() in sim.h)
+#ifdef VERTEX_PULLING
+// vertex pulling (CUBE_PULL=1): no buffer is bound at all, the
+// 24 line endpoints come from gl_VertexID. corner bits 4/2/1 pick -x/-y/-z,
+// same layout and edge order as gen_cube_outline()
+const int CUBE_EDGES[24] = int[24](0, 1, 1, 3, 3, 2, 2, 0, 4, 5, 5, 7, 7, 6,
+                                   6, 4, 0, 4, 1, 5, 2, 6, 3, 7);
+vec3 cubeCorner() {
+    int c = CUBE_EDGES[gl_VertexID];
+    return vec3((c & 4) != 0 ? -0.5 : 0.5, (c & 2) != 0 ? -0.5 : 0.5,
+                (c & 1) != 0 ? -0.5 : 0.5);
+}
+#else
+layout (location=0) in vec3 vertexPosition;
+vec3 cubeCorner() { return vertexPosition; }
+#endif
 
 uniform mat4 mvp;
-
-// Bullet uniforms (limit to 32 for safety)
-uniform int uBulletCount;
-uniform vec3 uBulletPos[32];
-uniform vec3 uBulletScale[32];
-uniform vec4 uBulletColor[32];
+uniform ivec3 uGridDims;
+uniform vec3 uGridMinCenter;
+uniform float uGridStep;
+
+// Bullet table (see BulletTable in main.c): 4 texels per bullet holding
+// position, velocity, scale and color, BULLET_TEX_ROW bullets per row. the
+// table only changes on spawn/despawn, positions are stored at the table's
+// epoch and uTime is the time since
+#define BULLET_TEXELS 4
+#define BULLET_TEX_ROW 256
+uniform highp sampler2D uBullets;
+uniform float uTime;
+
+// Per-brick bullet lists (see BulletBins in bins.h and BinTable in main.c),
+// one float per texel, BINS_TEX_ROW per row: brick offsets first (brick count
+// + 1 of them), then the bullet indices they point into
+#define BIN_BRICK 8
+#define BINS_TEX_ROW 1024
+uniform ivec3 uBrickDims;
+uniform highp sampler2D uBins;
 
 out vec4 vColor;
 
+vec4 bulletTexel(int i, int k) {
+    ivec2 at = ivec2((i % BULLET_TEX_ROW) * BULLET_TEXELS + k,
+                     i / BULLET_TEX_ROW);
+    return texelFetch(uBullets, at, 0);
+}
+
+vec3 bulletPos(int i) {
+    return bulletTexel(i, 0).xyz + bulletTexel(i, 1).xyz * uTime;
+}
+
+int binEntry(int i) {
+    ivec2 at = ivec2(i % BINS_TEX_ROW, i / BINS_TEX_ROW);
+    return int(texelFetch(uBins, at, 0).x);
+}
+
 void main() {
-    // Correct way to get cube center (translation column)
-    vec3 cubeCenter = instanceTransform[3].xyz;
+    int nx = uGridDims.x, ny = uGridDims.y;
+    ivec3 cell = ivec3(gl_InstanceID % nx, gl_InstanceID / nx % ny,
+                       gl_InstanceID / (nx * ny));
+    vec3 cubeCenter = uGridMinCenter + vec3(cell) * uGridStep;
 
     float side_len = 0.2;
     vec4 color = vec4(0.0);
 
-    for (int i = 0; i < uBulletCount; i++) {
-        vec3 d = abs((cubeCenter - uBulletPos[i]) / uBulletScale[i]);
+    ivec3 brick = cell / BIN_BRICK;
+    int b = (brick.z * uBrickDims.y + brick.y) * uBrickDims.x + brick.x;
+    int list = uBrickDims.x * uBrickDims.y * uBrickDims.z + 1;
+    int first = binEntry(b), last = binEntry(b + 1);
+    for (int j = first; j < last; j++) {
+        int i = binEntry(list + j);
+        vec3 d = abs((cubeCenter - bulletPos(i)) / bulletTexel(i, 2).xyz);
         float dist = d.x + d.y + d.z;
         float s = max(0.0, 1.0 * (1.0 - dist)); // scale by CUBE_SIZE if needed
         if (s > side_len) {
             side_len = s;
-            color = uBulletColor[i];
+            color = bulletTexel(i, 3);
         }
     }
 
     vColor = color;
 
     // Scale cube vertices by side_len
-    vec3 scaledPos = vertexPosition * side_len;
-    gl_Position = mvp * instanceTransform * vec4(scaledPos, 1.0);
+    vec3 scaledPos = cubeCorner() * side_len;
+    gl_Position = mvp * vec4(scaledPos + cubeCenter, 1.0);
 }
 
 
@@ -0,0 +1,282 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "field.h"
+#include "sim.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FIELD_X86 1
+#endif
+
+// ----------- ~%~ scalar ~%~ -----------
+
+// evaluates cubes [start, n), also used for the tails of the vector kernels.
+// expects `mask` to be zeroed already
+static inline int eval_row_from(const FieldRow *row, int start, int n,
+                                float *side_len, uint64_t *mask) {
+    const float eps = field_epsilon; // side_len could alias it
+    int lit = 0;
+    for (int i = start; i < n; i++) {
+        float x = row->x0 + (float)(row->first + i) * row->step;
+        float d = fabsf((row->bullet_x - x) * row->inv_sx) + row->dyz;
+        float s = fmaxf(0.0f, CUBE_SIZE - CUBE_SIZE * d);
+        side_len[i] = s;
+        if (s > eps) {
+            mask[i >> 6] |= 1ull << (i & 63);
+            lit++;
+        }
+    }
+    return lit;
+}
+
+int field_eval_row_scalar(const FieldRow *row, int n, float *side_len,
+                          uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    return eval_row_from(row, 0, n, side_len, mask);
+}
+
+static inline int eval_stamp_from(const float *l1, float d, int start, int n,
+                                  float *side_len, uint64_t *mask) {
+    const float eps = field_epsilon;
+    int lit = 0;
+    for (int i = start; i < n; i++) {
+        float s = fmaxf(0.0f, CUBE_SIZE - CUBE_SIZE * (l1[i] + d));
+        side_len[i] = s;
+        if (s > eps) {
+            mask[i >> 6] |= 1ull << (i & 63);
+            lit++;
+        }
+    }
+    return lit;
+}
+
+int field_eval_stamp_scalar(const float *l1, float d, int n, float *side_len,
+                            uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    return eval_stamp_from(l1, d, 0, n, side_len, mask);
+}
+
+// ----------- ~%~ bullets ~%~ -----------
+
+int bullet_advance_scalar(const BulletsHot *hot, int n, double time,
+                          const Grid *grid, uint64_t *in_grid) {
+    memset(in_grid, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        float t = (float)(time - hot->spawn_times[i]);
+        float x = hot->x0[i] + hot->vx[i] * t;
+        float y = hot->y0[i] + hot->vy[i] * t;
+        float z = hot->z0[i] + hot->vz[i] * t;
+        hot->px[i] = x;
+        hot->py[i] = y;
+        hot->pz[i] = z;
+        if (x + hot->sx[i] > grid->min.x && x - hot->sx[i] < grid->max.x &&
+            y + hot->sy[i] > grid->min.y && y - hot->sy[i] < grid->max.y &&
+            z + hot->sz[i] > grid->min.z && z - hot->sz[i] < grid->max.z) {
+            in_grid[i >> 6] |= 1ull << (i & 63);
+            count++;
+        }
+    }
+    return count;
+}
+
+#ifdef FIELD_X86
+
+// ----------- ~%~ sse2 ~%~ -----------
+
+static int field_eval_row_sse2(const FieldRow *row, int n, float *side_len,
+                               uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 bx = _mm_set1_ps(row->bullet_x);
+    const __m128 inv = _mm_set1_ps(row->inv_sx);
+    const __m128 dyz = _mm_set1_ps(row->dyz);
+    const __m128 x0 = _mm_set1_ps(row->x0);
+    const __m128 step = _mm_set1_ps(row->step);
+    const __m128 size = _mm_set1_ps(CUBE_SIZE);
+    const __m128 eps = _mm_set1_ps(field_epsilon);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+    int lit = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 idx = _mm_add_ps(_mm_set1_ps((float)(row->first + i)), lane);
+        __m128 x = _mm_add_ps(x0, _mm_mul_ps(idx, step));
+        __m128 d = _mm_mul_ps(_mm_sub_ps(bx, x), inv);
+        d = _mm_add_ps(_mm_andnot_ps(sign, d), dyz);
+        __m128 s = _mm_max_ps(zero, _mm_sub_ps(size, _mm_mul_ps(size, d)));
+        _mm_storeu_ps(side_len + i, s);
+        unsigned bits = _mm_movemask_ps(_mm_cmpgt_ps(s, eps));
+        mask[i >> 6] |= (uint64_t)bits << (i & 63);
+        lit += __builtin_popcount(bits);
+    }
+    return lit + eval_row_from(row, i, n, side_len, mask);
+}
+
+static int field_eval_stamp_sse2(const float *l1, float d, int n,
+                                 float *side_len, uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    const __m128 dm = _mm_set1_ps(d);
+    const __m128 size = _mm_set1_ps(CUBE_SIZE);
+    const __m128 eps = _mm_set1_ps(field_epsilon);
+    const __m128 zero = _mm_setzero_ps();
+
+    int lit = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 dist = _mm_add_ps(_mm_loadu_ps(l1 + i), dm);
+        __m128 s = _mm_max_ps(zero, _mm_sub_ps(size, _mm_mul_ps(size, dist)));
+        _mm_storeu_ps(side_len + i, s);
+        unsigned bits = _mm_movemask_ps(_mm_cmpgt_ps(s, eps));
+        mask[i >> 6] |= (uint64_t)bits << (i & 63);
+        lit += __builtin_popcount(bits);
+    }
+    return lit + eval_stamp_from(l1, d, i, n, side_len, mask);
+}
+
+// ----------- ~%~ avx2 ~%~ -----------
+
+__attribute__((target("avx2"))) static int
+field_eval_row_avx2(const FieldRow *row, int n, float *side_len,
+                    uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 bx = _mm256_set1_ps(row->bullet_x);
+    const __m256 inv = _mm256_set1_ps(row->inv_sx);
+    const __m256 dyz = _mm256_set1_ps(row->dyz);
+    const __m256 x0 = _mm256_set1_ps(row->x0);
+    const __m256 step = _mm256_set1_ps(row->step);
+    const __m256 size = _mm256_set1_ps(CUBE_SIZE);
+    const __m256 eps = _mm256_set1_ps(field_epsilon);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 lane =
+        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+
+    int lit = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 idx =
+            _mm256_add_ps(_mm256_set1_ps((float)(row->first + i)), lane);
+        __m256 x = _mm256_add_ps(x0, _mm256_mul_ps(idx, step));
+        __m256 d = _mm256_mul_ps(_mm256_sub_ps(bx, x), inv);
+        d = _mm256_add_ps(_mm256_andnot_ps(sign, d), dyz);
+        __m256 s =
+            _mm256_max_ps(zero, _mm256_sub_ps(size, _mm256_mul_ps(size, d)));
+        _mm256_storeu_ps(side_len + i, s);
+        unsigned bits =
+            _mm256_movemask_ps(_mm256_cmp_ps(s, eps, _CMP_GT_OQ));
+        mask[i >> 6] |= (uint64_t)bits << (i & 63);
+        lit += __builtin_popcount(bits);
+    }
+    return lit + eval_row_from(row, i, n, side_len, mask);
+}
+
+__attribute__((target("avx2"))) static int
+field_eval_stamp_avx2(const float *l1, float d, int n, float *side_len,
+                      uint64_t *mask) {
+    memset(mask, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    const __m256 dm = _mm256_set1_ps(d);
+    const __m256 size = _mm256_set1_ps(CUBE_SIZE);
+    const __m256 eps = _mm256_set1_ps(field_epsilon);
+    const __m256 zero = _mm256_setzero_ps();
+
+    int lit = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 dist = _mm256_add_ps(_mm256_loadu_ps(l1 + i), dm);
+        __m256 s = _mm256_max_ps(zero,
+                                 _mm256_sub_ps(size, _mm256_mul_ps(size, dist)));
+        _mm256_storeu_ps(side_len + i, s);
+        unsigned bits =
+            _mm256_movemask_ps(_mm256_cmp_ps(s, eps, _CMP_GT_OQ));
+        mask[i >> 6] |= (uint64_t)bits << (i & 63);
+        lit += __builtin_popcount(bits);
+    }
+    return lit + eval_stamp_from(l1, d, i, n, side_len, mask);
+}
+
+// one axis of the in-grid test: min < p + s && p - s < max
+__attribute__((target("avx2"))) static inline __m256
+overlaps_avx2(__m256 p, __m256 s, float min, float max) {
+    __m256 lo = _mm256_cmp_ps(_mm256_add_ps(p, s), _mm256_set1_ps(min),
+                              _CMP_GT_OQ);
+    __m256 hi = _mm256_cmp_ps(_mm256_sub_ps(p, s), _mm256_set1_ps(max),
+                              _CMP_LT_OQ);
+    return _mm256_and_ps(lo, hi);
+}
+
+// the hot arrays are BULLET_ALIGN aligned and padded, so every load and
+// store is aligned and there's no scalar tail. the spawn time difference is
+// taken in double, like bullet_pos(), and narrowed 4 lanes at a time
+__attribute__((target("avx2"))) static int
+bullet_advance_avx2(const BulletsHot *hot, int n, double time,
+                    const Grid *grid, uint64_t *in_grid) {
+    memset(in_grid, 0, FIELD_MASK_WORDS(n) * sizeof(uint64_t));
+    const __m256d now = _mm256_set1_pd(time);
+    int count = 0;
+    for (int i = 0; i < n; i += 8) {
+        __m128 t_lo = _mm256_cvtpd_ps(
+            _mm256_sub_pd(now, _mm256_load_pd(hot->spawn_times + i)));
+        __m128 t_hi = _mm256_cvtpd_ps(
+            _mm256_sub_pd(now, _mm256_load_pd(hot->spawn_times + i + 4)));
+        __m256 t = _mm256_set_m128(t_hi, t_lo);
+        __m256 x = _mm256_add_ps(_mm256_load_ps(hot->x0 + i),
+                                 _mm256_mul_ps(_mm256_load_ps(hot->vx + i), t));
+        __m256 y = _mm256_add_ps(_mm256_load_ps(hot->y0 + i),
+                                 _mm256_mul_ps(_mm256_load_ps(hot->vy + i), t));
+        __m256 z = _mm256_add_ps(_mm256_load_ps(hot->z0 + i),
+                                 _mm256_mul_ps(_mm256_load_ps(hot->vz + i), t));
+        _mm256_store_ps(hot->px + i, x);
+        _mm256_store_ps(hot->py + i, y);
+        _mm256_store_ps(hot->pz + i, z);
+
+        __m256 in = overlaps_avx2(x, _mm256_load_ps(hot->sx + i),
+                                  grid->min.x, grid->max.x);
+        in = _mm256_and_ps(in, overlaps_avx2(y, _mm256_load_ps(hot->sy + i),
+                                             grid->min.y, grid->max.y));
+        in = _mm256_and_ps(in, overlaps_avx2(z, _mm256_load_ps(hot->sz + i),
+                                             grid->min.z, grid->max.z));
+        unsigned bits = _mm256_movemask_ps(in);
+        in_grid[i >> 6] |= (uint64_t)bits << (i & 63);
+        count += __builtin_popcount(bits);
+    }
+    return count;
+}
+
+#endif // FIELD_X86
+
+// ----------- ~%~ dispatch ~%~ -----------
+
+float field_epsilon = EPSILON;
+FieldRowFn field_eval_row = field_eval_row_scalar;
+FieldStampFn field_eval_stamp = field_eval_stamp_scalar;
+BulletAdvanceFn bullet_advance = bullet_advance_scalar;
+static const char *kernel_name = "scalar";
+
+void field_init() {
+    const char *want = getenv("CUBE_KERNEL");
+    field_eval_row = field_eval_row_scalar;
+    field_eval_stamp = field_eval_stamp_scalar;
+    bullet_advance = bullet_advance_scalar;
+    kernel_name = "scalar";
+    if (want && strcmp(want, "scalar") == 0)
+        return;
+#ifdef FIELD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        field_eval_row = field_eval_row_sse2;
+        field_eval_stamp = field_eval_stamp_sse2;
+        kernel_name = "sse2";
+    }
+    if (want && strcmp(want, "sse2") == 0)
+        return;
+    if (__builtin_cpu_supports("avx2")) {
+        field_eval_row = field_eval_row_avx2;
+        field_eval_stamp = field_eval_stamp_avx2;
+        bullet_advance = bullet_advance_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+}
+
+const char *field_kernel_name() { return kernel_name; }
@@ -0,0 +1,75 @@
+#ifndef FIELD_H
+#define FIELD_H
+
+#include <stdint.h>
+//
+#include "sim.h"
+
+// Vectorized octahedron field evaluation along one x-row of a BulletBox.
+//
+// Cube centers along a row are evenly spaced, so a row is described by the
+// grid origin, the spacing and the first x index to evaluate. Centers are
+// always derived from the origin, so results don't depend on where a row
+// starts. The per-row y/z part of the L1 distance is constant and is folded
+// into `dyz` by the caller.
+//
+// Writes side_len for n cubes into `side_len` and sets bit i of `mask` (one
+// uint64_t per 64 cubes) for every cube whose side_len > field_epsilon.
+// Returns the number of lit cubes.
+
+typedef struct FieldRow {
+    float bullet_x; // bullet center
+    float inv_sx;   // 1 / scale.x
+    float dyz;      // |dy / scale.y| + |dz / scale.z|
+    float x0;       // center of cube x = 0
+    float step;     // CUBE_SIZE + CUBE_PADDING
+    int first;      // x index of the first cube evaluated
+} FieldRow;
+
+typedef int (*FieldRowFn)(const FieldRow *row, int n, float *side_len,
+                          uint64_t *mask);
+
+#define FIELD_MASK_WORDS(n) (((n) + 63) / 64)
+
+// lit cutoff of every kernel, EPSILON unless the quality governor raises it
+// to drop tiny cubes. only change it between evaluations
+extern float field_epsilon;
+
+// picks the widest kernel the cpu supports, unless overridden through the
+// CUBE_KERNEL=scalar|sse2|avx2 environment variable
+void field_init();
+const char *field_kernel_name();
+extern FieldRowFn field_eval_row;
+
+int field_eval_row_scalar(const FieldRow *row, int n, float *side_len,
+                          uint64_t *mask);
+
+// Stamped rows, for bullets moving along y or z (see BulletStamp): the x-row
+// of the bullet's stamp already holds the L1 distance over x and the other
+// fixed axis, so a cube is just side_len = CUBE_SIZE * (1 - (l1[i] + d)),
+// with `d` the motion axis part shared by the whole row. Same outputs as
+// field_eval_row().
+
+typedef int (*FieldStampFn)(const float *l1, float d, int n, float *side_len,
+                            uint64_t *mask);
+
+extern FieldStampFn field_eval_stamp;
+
+int field_eval_stamp_scalar(const float *l1, float d, int n, float *side_len,
+                            uint64_t *mask);
+
+// Bullet advance, for bullets_advance(): evaluates the closed-form position
+// of bullets [0, n) at `time` into hot->px/py/pz and sets bit i of `in_grid`
+// for every bullet whose bounding box overlaps the grid's bounds, clearing
+// the rest. n is a multiple of BULLET_LANES. Returns the number of set bits.
+// Picked by field_init() along with the row kernels.
+
+typedef int (*BulletAdvanceFn)(const BulletsHot *hot, int n, double time,
+                               const Grid *grid, uint64_t *in_grid);
+
+extern BulletAdvanceFn bullet_advance;
+
+int bullet_advance_scalar(const BulletsHot *hot, int n, double time,
+                          const Grid *grid, uint64_t *in_grid);
+
+#endif // FIELD_H
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "field.h"
+#include "governor.h"
+
+const QualityLevel quality_levels[QUALITY_LEVELS] = {
+    {1.00f, 1.00f, EPSILON, 1.00f},
+    {0.75f, 1.25f, 0.05f, 1.00f},
+    {0.50f, 1.50f, 0.10f, 0.85f},
+    {0.35f, 2.00f, 0.15f, 0.70f},
+    {0.25f, 3.00f, 0.20f, 0.50f},
+};
+
+Governor governor_init(int target_fps) {
+    const char *env = getenv("CUBE_GOVERNOR");
+    return (Governor){
+        .enabled = !(env && atoi(env) == 0),
+        .budget = 1000000000ull / (uint64_t)(target_fps > 0 ? target_fps : 60),
+        .skip = GOVERNOR_WARMUP,
+        .up_frames = GOVERNOR_UP_FRAMES,
+    };
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// sorts a copy, the ring stays in order
+static uint32_t p90(const uint32_t *ring) {
+    uint32_t sorted[GOVERNOR_WINDOW];
+    memcpy(sorted, ring, sizeof(sorted));
+    qsort(sorted, GOVERNOR_WINDOW, sizeof(uint32_t), cmp_u32);
+    return sorted[GOVERNOR_WINDOW * 9 / 10];
+}
+
+int governor_frame(Governor *gov, uint64_t wall_ns, uint64_t busy_ns) {
+    if (!gov->enabled)
+        return 0;
+    if (gov->skip > 0) {
+        gov->skip--;
+        return 0;
+    }
+    gov->wall[gov->head] = wall_ns > UINT32_MAX ? UINT32_MAX : wall_ns;
+    gov->busy[gov->head] = busy_ns > UINT32_MAX ? UINT32_MAX : busy_ns;
+    gov->head = (gov->head + 1) % GOVERNOR_WINDOW;
+    if (gov->count < GOVERNOR_WINDOW && ++gov->count < GOVERNOR_WINDOW)
+        return 0;
+
+    uint32_t wall = p90(gov->wall);
+    uint32_t busy = p90(gov->busy);
+    int from = gov->level;
+    if (wall > GOVERNOR_DOWN * gov->budget) {
+        gov->good = 0;
+        // the level it just climbed to didn't hold, be slower to try again
+        if (gov->climbed && gov->up_frames < GOVERNOR_MAX_UP_FRAMES)
+            gov->up_frames *= 2;
+        if (gov->level < QUALITY_LEVELS - 1)
+            gov->level++;
+    } else {
+        // a full ring at a level it just climbed to without misses, it held
+        if (gov->climbed)
+            gov->up_frames = GOVERNOR_UP_FRAMES;
+        gov->good = busy < GOVERNOR_UP * gov->budget ? gov->good + 1 : 0;
+        if (gov->good >= gov->up_frames && gov->level > 0) {
+            gov->level--;
+            gov->good = 0;
+        }
+    }
+    gov->climbed = gov->level < from;
+    if (gov->level == from)
+        return 0;
+
+    const QualityLevel *q = &quality_levels[gov->level];
+    fprintf(stderr,
+            "governor: p90 frame %.2f ms, busy %.2f ms, budget %.2f ms: "
+            "quality %d -> %d (bullets %.0f%%, spawn delay x%.2f, "
+            "epsilon %.2f, resolution %.0f%%)\n",
+            wall / 1e6, busy / 1e6, gov->budget / 1e6, from, gov->level,
+            q->bullets * 100.0f, q->spawn_delay, q->epsilon,
+            q->res_scale * 100.0f);
+    // the ring holds the old level's frames, start it over
+    gov->head = 0;
+    gov->count = 0;
+    gov->skip = GOVERNOR_SETTLE;
+    return 1;
+}
+
+void quality_apply(Sim *sim, int level) {
+    const QualityLevel *q = &quality_levels[level];
+    Bullets *bullets = &sim->bullets;
+    int limit = (int)(bullets->cap * q->bullets);
+    bullets->live_limit = limit > 1 ? limit : 1;
+    sim->spawn_throttle = q->spawn_delay;
+    field_epsilon = q->epsilon;
+}
@@ -0,0 +1,76 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdint.h>
+//
+#include "sim.h"
+
+// Adaptive quality governor: trades detail for a steady frame rate.
+//
+// Frame times go into a ring of the last GOVERNOR_WINDOW frames, and once
+// it's full its p90 is held against the frame budget (one refresh interval)
+// every frame: if frames were missed the quality drops a level, if there
+// was plenty of headroom for GOVERNOR_UP_FRAMES frames in a row it's raised
+// a level. After a change the ring starts over, so every decision is made
+// on frames of the current level only. The gap between the two thresholds
+// keeps it from settling on a level it can't hold, and a level that has to
+// be left again right after being entered makes the next climb wait twice
+// as long (up to GOVERNOR_MAX_UP_FRAMES, a few minutes).
+//
+// Each frame is measured twice: wall time (frame end to frame end) shows
+// missed frames, busy time (wall time minus what the frame spent blocked on
+// present and frame pacing) shows how much headroom there is. Both count
+// against the budget, since with vsync or a frame cap the wall time never
+// drops below it. With a pipelined sim the producer's frame time counts as
+// both: the main thread redraws the last frame rather than wait for it, so
+// a slow producer never shows in its own wall time.
+//
+// Every decision is logged to stderr with the numbers behind it.
+
+#define GOVERNOR_WINDOW 60
+#define GOVERNOR_DOWN 1.10f // p90 wall time over this many budgets steps down
+#define GOVERNOR_UP 0.70f   // p90 busy time under this many budgets is headroom
+#define GOVERNOR_UP_FRAMES (3 * GOVERNOR_WINDOW)
+#define GOVERNOR_MAX_UP_FRAMES (384 * GOVERNOR_WINDOW)
+// frames ignored at startup (shader builds, first uploads) and after a
+// change (the new level's first frames)
+#define GOVERNOR_WARMUP 120
+#define GOVERNOR_SETTLE 10
+
+// what a level turns down, level 0 is full detail
+typedef struct QualityLevel {
+    float bullets;     // fraction of the bullet cap that may be live
+    float spawn_delay; // multiplier on spawn delays
+    float epsilon;     // field_epsilon, smaller cubes aren't drawn
+    float res_scale;   // render resolution, of the window's
+} QualityLevel;
+
+#define QUALITY_LEVELS 5
+extern const QualityLevel quality_levels[QUALITY_LEVELS];
+
+typedef struct Governor {
+    int enabled;
+    uint64_t budget; // ns per frame
+    uint32_t wall[GOVERNOR_WINDOW], busy[GOVERNOR_WINDOW]; // ring
+    int head;        // next slot to write
+    int count;       // frames in the ring
+    int skip;        // frames left to ignore
+    int level;       // index into quality_levels
+    int good;        // frames in a row with headroom
+    int up_frames;   // needed to step up
+    int climbed;     // the last change was a step up
+} Governor;
+
+// target_fps <= 0 budgets for 60. CUBE_GOVERNOR=0 disables it: it stays at
+// full quality
+Governor governor_init(int target_fps);
+// feeds one frame, returns 1 if the level changed
+int governor_frame(Governor *gov, uint64_t wall_ns, uint64_t busy_ns);
+
+// applies the sim side of `level`: the live bullet limit, the spawn
+// throttle and field_epsilon. bullets over a lowered limit live out their
+// flight, only new spawns wait. call it on the thread that owns the sim,
+// between pool evaluations
+void quality_apply(Sim *sim, int level);
+
+#endif // GOVERNOR_H
@@ -0,0 +1,379 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl31.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "bins.h"
+#include "field.h"
+#include "gpufield.h"
+#include "gputimer.h"
+#include "linebatch.h"
+#include "pool.h"
+#include "profiler.h"
+#include "sim.h"
+
+// Headless check of the compute field (field.comp) against the cpu pool,
+// no window or GPU needed: runs on Mesa's llvmpipe through a surfaceless EGL
+// context (LIBGL_ALWAYS_SOFTWARE=1 forces it on machines that have a GPU).
+// usage: ./gpu_check [frames] [dt]
+//    (or: make gpu-check gpu_check_args="frames dt")
+// every few frames the GPU instance buffer is read back (only here, the
+// renderer never does) and each lit cube is compared with the cpu field.
+// the dispatch is also timed with GL timer queries (gputimer.h), read back
+// asynchronously like in the renderer. llvmpipe runs dispatches outside the
+// command stream its queries time, so there it reads ~0. draws do time, so
+// the field's output is also drawn every frame like the renderer's indirect
+// path (linecube.vs, vertex pulling) into a DRAW_SIZE offscreen target and
+// timed as PROF_GPU_CUBES: the check fails if that has no results after
+// GPU_TIMER_SLOTS frames or its p50 is 0.
+
+#define DEFAULT_FRAMES 600
+#define DEFAULT_DT (1.0f / 60.0f)
+#define CHECK_EVERY 30
+// side_len differs by float rounding and the unorm16 step
+#define SIDE_TOLERANCE (2.0f / 65535.0f + 1e-4f)
+#define DRAW_SIZE 512
+
+typedef struct Expected {
+    int lit;
+    float side_len;
+    int palette;
+} Expected;
+
+static int make_context() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+            "eglGetPlatformDisplayEXT");
+    EGLDisplay dpy =
+        get_display
+            ? get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                          NULL)
+            : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL))
+        return 0;
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLint config_attrs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                             EGL_NONE};
+    // surfaceless displays may have no configs at all, we never draw to a
+    // surface anyway (EGL_KHR_no_config_context)
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint configs = 0;
+    if (!eglChooseConfig(dpy, config_attrs, &config, 1, &configs) ||
+        configs < 1)
+        config = EGL_NO_CONFIG_KHR;
+    EGLint ctx_attrs[] = {EGL_CONTEXT_MAJOR_VERSION, 3,
+                          EGL_CONTEXT_MINOR_VERSION, 1, EGL_NONE};
+    EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, ctx_attrs);
+    return ctx != EGL_NO_CONTEXT &&
+           eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+}
+
+// the renderer's indirect cube draw, minus raylib
+typedef struct DrawPass {
+    GLuint program, vao, fbo, color, palette;
+} DrawPass;
+
+static char *read_text(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(len + 1);
+    if (text && fread(text, 1, len, f) == (size_t)len) {
+        text[len] = 0;
+    } else {
+        free(text);
+        text = NULL;
+    }
+    fclose(f);
+    return text;
+}
+
+// `define` goes right after the #version line
+static GLuint compile(GLenum type, const char *path, const char *define) {
+    char *src = read_text(path);
+    if (!src) {
+        fprintf(stderr, "can't read %s\n", path);
+        return 0;
+    }
+    char *body = strchr(src, '\n');
+    body = body ? body + 1 : src + strlen(src);
+    const char *parts[] = {src, define, body};
+    GLint lens[] = {(GLint)(body - src), (GLint)strlen(define), -1};
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 3, parts, lens);
+    glCompileShader(shader);
+    free(src);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "%s failed to compile %s\n", path, log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static int draw_pass_create(DrawPass *pass, const Grid *grid,
+                            const GpuField *field) {
+    *pass = (DrawPass){0};
+    GLuint vs = compile(GL_VERTEX_SHADER, "linecube.vs",
+                        "#define VERTEX_PULLING\n");
+    GLuint fs = compile(GL_FRAGMENT_SHADER, "cubegrid.fs", "");
+    if (!vs || !fs)
+        return 0;
+    pass->program = glCreateProgram();
+    glAttachShader(pass->program, vs);
+    glAttachShader(pass->program, fs);
+    glLinkProgram(pass->program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint ok = 0;
+    glGetProgramiv(pass->program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        fprintf(stderr, "cube draw program failed to link\n");
+        return 0;
+    }
+
+    // whole grid in view, flat on z
+    float extent = fmaxf(grid->size.x, fmaxf(grid->size.y, grid->size.z));
+    float k = 1.8f / extent;
+    float mvp[16] = {k, 0, 0, 0, 0, k, 0, 0, 0, 0, k * 0.5f, 0, 0, 0, 0, 1};
+    glUseProgram(pass->program);
+    glUniformMatrix4fv(glGetUniformLocation(pass->program, "mvp"), 1,
+                       GL_FALSE, mvp);
+    glUniform3f(glGetUniformLocation(pass->program, "uGridMinCenter"),
+                grid->min_center.x, grid->min_center.y, grid->min_center.z);
+    glUniform1f(glGetUniformLocation(pass->program, "uGridStep"),
+                grid->step);
+    glUniform1i(glGetUniformLocation(pass->program, "uPalette"), 0);
+    glUseProgram(0);
+
+    uint8_t palette[PALETTE_SIZE * 4];
+    palette_build(palette);
+    glGenTextures(1, &pass->palette);
+    glBindTexture(GL_TEXTURE_2D, pass->palette);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, PALETTE_SIZE, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, PALETTE_SIZE, 1, GL_RGBA,
+                    GL_UNSIGNED_BYTE, palette);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &pass->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, pass->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, DRAW_SIZE, DRAW_SIZE);
+    glGenFramebuffers(1, &pass->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, pass->color);
+    ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!ok) {
+        fprintf(stderr, "cube draw target is incomplete\n");
+        return 0;
+    }
+
+    // the instance stream, as bind_instance_stream() in main.c sets it up
+    glGenVertexArrays(1, &pass->vao);
+    glBindVertexArray(pass->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gpu_field_instances(field));
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(CubeInstance),
+                           (void *)offsetof(CubeInstance, cell));
+    glVertexAttribPointer(2, 1, GL_UNSIGNED_SHORT, GL_TRUE,
+                          sizeof(CubeInstance),
+                          (void *)offsetof(CubeInstance, side_len));
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(CubeInstance),
+                           (void *)offsetof(CubeInstance, color));
+    for (GLuint loc = 1; loc <= 3; loc++) {
+        glEnableVertexAttribArray(loc);
+        glVertexAttribDivisor(loc, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return 1;
+}
+
+// timed from after the clear, like the renderer's cube pass: llvmpipe
+// reads a query begun before a framebuffer switch as a bogus timestamp
+static void draw_pass_run(const DrawPass *pass, const GpuField *field,
+                          GpuTimer *timer) {
+    glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo);
+    glViewport(0, 0, DRAW_SIZE, DRAW_SIZE);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    gpu_timer_begin(timer, PROF_GPU_CUBES);
+    glUseProgram(pass->program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pass->palette);
+    glBindVertexArray(pass->vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpu_field_command(field));
+    glDrawArraysIndirect(GL_LINES, 0);
+    gpu_timer_end(timer, PROF_GPU_CUBES);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+static void draw_pass_destroy(DrawPass *pass) {
+    glDeleteProgram(pass->program);
+    glDeleteVertexArrays(1, &pass->vao);
+    glDeleteFramebuffers(1, &pass->fbo);
+    glDeleteRenderbuffers(1, &pass->color);
+    glDeleteTextures(1, &pass->palette);
+}
+
+static void expect_cube(void *user, int cube_idx, Vector3 cube_pos,
+                        float side_len, Vector4 color) {
+    (void)cube_pos;
+    Expected *e = &((Expected *)user)[cube_idx];
+    *e = (Expected){1, side_len, palette_index(color)};
+}
+
+static inline double now_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    long frames = argc > 1 ? atol(argv[1]) : DEFAULT_FRAMES;
+    float dt = argc > 2 ? (float)atof(argv[2]) : DEFAULT_DT;
+    if (frames <= 0 || dt <= 0.0f) {
+        fprintf(stderr, "usage: %s [frames] [dt]\n", argv[0]);
+        return 1;
+    }
+    if (!make_context()) {
+        fprintf(stderr, "no GLES 3.1 context\n");
+        return 1;
+    }
+    printf("renderer: %s (%s)\n", glGetString(GL_RENDERER),
+           glGetString(GL_VERSION));
+
+    field_init();
+    static Sim sim;
+    sim_init(&sim, grid_init(0, 0, 0), 0);
+    FieldPool *pool = pool_create(0);
+    pool_set_blend(pool, BLEND_MAX);
+    BulletBins bins;
+    bins_init(&bins, &sim.grid);
+    GpuField *field = gpu_field_create(&sim.grid, sim.bullets.cap);
+    if (!field)
+        return 1;
+    Profiler *prof = prof_create("gpu_check", 1);
+    prof_bind(prof);
+    GpuTimer *timer = gpu_timer_create();
+    DrawPass draw;
+    if (!draw_pass_create(&draw, &sim.grid, field))
+        return 1;
+
+    int cubes = grid_count(&sim.grid);
+    Expected *expected = malloc(cubes * sizeof(Expected));
+    long checked = 0, missing = 0, extra = 0, wrong = 0;
+    double gpu_time = 0.0;
+    int timer_late = 0;
+    ProfStats stats;
+    for (long f = 0; f < frames; f++) {
+        prof_frame_begin();
+        gpu_timer_frame(timer);
+        sim_step(&sim, dt);
+        bins_build(&bins, &sim);
+        double start = now_s();
+        gpu_timer_begin(timer, PROF_GPU_FIELD);
+        gpu_field_eval(field, &sim, &bins);
+        gpu_timer_end(timer, PROF_GPU_FIELD);
+        glFinish();
+        gpu_time += now_s() - start;
+        draw_pass_run(&draw, field, timer);
+        prof_frame_end();
+        // every slot's been read by now, unless the timer never delivers
+        if (f == GPU_TIMER_SLOTS) {
+            prof_stats(prof, PROF_FRAMES, &stats);
+            timer_late = stats.gpu_frames[PROF_GPU_CUBES] == 0;
+        }
+        if (f % CHECK_EVERY)
+            continue;
+
+        memset(expected, 0, cubes * sizeof(Expected));
+        pool_eval(pool, &sim);
+        pool_for_each_hit(pool, expect_cube, expected);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_field_command(field));
+        const GLuint *cmd = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
+                                             5 * sizeof(GLuint),
+                                             GL_MAP_READ_BIT);
+        int count = (int)cmd[1];
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_field_instances(field));
+        const CubeInstance *inst =
+            count ? glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0,
+                                     count * sizeof(CubeInstance),
+                                     GL_MAP_READ_BIT)
+                  : NULL;
+        for (int i = 0; i < count; i++) {
+            uint32_t c = inst[i].cell;
+            int idx = grid_idx(&sim.grid, c & INSTANCE_CELL_MASK,
+                               c >> INSTANCE_CELL_BITS & INSTANCE_CELL_MASK,
+                               c >> 2 * INSTANCE_CELL_BITS);
+            Expected *e = &expected[idx];
+            float side = inst[i].side_len / 65535.0f * CUBE_SIZE;
+            if (!e->lit) {
+                // cubes right at the threshold can round either way
+                extra += side > SIDE_TOLERANCE;
+            } else if (fabsf(side - e->side_len) > SIDE_TOLERANCE ||
+                       inst[i].color != e->palette) {
+                wrong++;
+            }
+            if (e->lit)
+                e->lit = 2;
+            checked++;
+        }
+        if (count)
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        for (int i = 0; i < cubes; i++)
+            missing += expected[i].lit == 1 &&
+                       expected[i].side_len > SIDE_TOLERANCE;
+    }
+
+    printf("frames: %ld, cubes checked: %ld, missing: %ld, extra: %ld, "
+           "wrong: %ld\n",
+           frames, checked, missing, extra, wrong);
+    printf("compute field: %.1f us/frame (upload + dispatch + finish)\n",
+           gpu_time * 1e6 / (double)frames);
+    prof_stats(prof, PROF_FRAMES, &stats);
+    for (int pass = PROF_GPU_FIELD; pass <= PROF_GPU_CUBES; pass++) {
+        int timed = stats.gpu_frames[pass];
+        if (timed > 0)
+            printf("gpu timer: %s p50 %.1f us, p99 %.1f us (%d frames)\n",
+                   prof_gpu_pass_name(pass), stats.gpu_p50[pass] / 1e3,
+                   stats.gpu_p99[pass] / 1e3, timed);
+        else
+            printf("gpu timer: %s has no results\n",
+                   prof_gpu_pass_name(pass));
+    }
+    // compute dispatches may read 0 (llvmpipe), draws may not
+    int timer_failed = !timer || timer_late ||
+                       stats.gpu_p50[PROF_GPU_CUBES] == 0;
+    if (!timer)
+        printf("gpu timer: not available\n");
+    else if (timer_late)
+        printf("gpu timer: no results within %d frames\n", GPU_TIMER_SLOTS);
+    draw_pass_destroy(&draw);
+    gpu_timer_destroy(timer);
+    prof_destroy(prof);
+    free(expected);
+    gpu_field_destroy(field);
+    bins_free(&bins);
+    pool_destroy(pool);
+    sim_free(&sim);
+    return missing || extra || wrong || timer_failed;
+}
@@ -0,0 +1,278 @@
+#include <GLES3/gl31.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "field.h"
+#include "gpufield.h"
+#include "linebatch.h"
+#include "profiler.h"
+
+#define FIELD_SHADER "field.comp"
+#define LOCAL_SIZE 64
+#define MAX_GROUPS_X 65535
+
+// std430 layouts, keep in sync with field.comp
+typedef struct GpuBullet {
+    float x, y, z, palette; // position at the table's epoch
+    float vx, vy, vz, pad0;
+    float inv_sx, inv_sy, inv_sz, pad1;
+} GpuBullet;
+
+typedef struct DrawCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint reserved;
+} DrawCommand;
+
+struct GpuField {
+    GLuint program;
+    GLint time_loc, active_loc, epsilon_loc;
+    GLuint command, bullets, bins, instances, active;
+    int bins_cap;   // in uints, only ever grows
+    int cap;        // in instances
+    int bullet_cap;
+    unsigned version; // Bullets.version in the bullet buffer
+    double epoch;     // sim time the buffered positions are at
+    GpuBullet *staging;
+    GLuint *bins_staging;
+};
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    rewind(f);
+    char *text = malloc(len + 1);
+    if (text && fread(text, 1, len, f) == (size_t)len) {
+        text[len] = '\0';
+    } else {
+        free(text);
+        text = NULL;
+    }
+    fclose(f);
+    return text;
+}
+
+static GLuint build_program(const char *path) {
+    char *src = read_file(path);
+    if (!src) {
+        fprintf(stderr, "gpu field: can't read %s\n", path);
+        return 0;
+    }
+    char log[1024];
+    GLint ok = 0;
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    if (shader) {
+        glShaderSource(shader, 1, (const char *const *)&src, NULL);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    }
+    free(src);
+    if (!ok) {
+        if (shader) {
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            glDeleteShader(shader);
+        }
+        fprintf(stderr, "gpu field: %s failed to compile %s\n", path,
+                shader ? log : "(no compute shader support)");
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "gpu field: %s failed to link %s\n", path, log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static GLuint make_buffer(GLenum target, GLsizeiptr size, GLenum usage) {
+    GLuint buf;
+    glGenBuffers(1, &buf);
+    glBindBuffer(target, buf);
+    glBufferData(target, size, NULL, usage);
+    glBindBuffer(target, 0);
+    return buf;
+}
+
+GpuField *gpu_field_create(const Grid *grid, int bullet_cap) {
+    // glGetError() first so a stale error isn't blamed on us
+    while (glGetError() != GL_NO_ERROR)
+        ;
+    GLuint program = build_program(FIELD_SHADER);
+    if (!program)
+        return NULL;
+
+    GpuField *field = calloc(1, sizeof(GpuField));
+    if (!field) {
+        fprintf(stderr, "out of memory creating gpu field\n");
+        exit(1);
+    }
+    int cubes = grid_count(grid);
+    field->program = program;
+    field->time_loc = glGetUniformLocation(program, "uTime");
+    field->active_loc = glGetUniformLocation(program, "uActiveCount");
+    field->epsilon_loc = glGetUniformLocation(program, "uEpsilon");
+    field->version = ~0u;
+    field->cap = cubes < GPU_FIELD_MAX_INSTANCES ? cubes
+                                                 : GPU_FIELD_MAX_INSTANCES;
+    field->bullet_cap = bullet_cap;
+    field->staging = malloc(bullet_cap * sizeof(GpuBullet));
+    if (!field->staging) {
+        fprintf(stderr, "out of memory creating gpu field\n");
+        exit(1);
+    }
+    field->command = make_buffer(GL_DRAW_INDIRECT_BUFFER,
+                                 sizeof(DrawCommand), GL_DYNAMIC_DRAW);
+    field->bullets = make_buffer(GL_SHADER_STORAGE_BUFFER,
+                                 bullet_cap * sizeof(GpuBullet),
+                                 GL_DYNAMIC_DRAW);
+    field->bins = make_buffer(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint),
+                              GL_DYNAMIC_DRAW);
+    field->instances = make_buffer(GL_SHADER_STORAGE_BUFFER,
+                                   field->cap * sizeof(CubeInstance),
+                                   GL_DYNAMIC_COPY);
+    int bricks = ((grid->nx + BIN_BRICK - 1) / BIN_BRICK) *
+                 ((grid->ny + BIN_BRICK - 1) / BIN_BRICK) *
+                 ((grid->nz + BIN_BRICK - 1) / BIN_BRICK);
+    field->active = make_buffer(GL_SHADER_STORAGE_BUFFER,
+                                bricks * sizeof(GLuint), GL_DYNAMIC_DRAW);
+
+    glUseProgram(program);
+    glUniform3i(glGetUniformLocation(program, "uGridDims"), grid->nx,
+                grid->ny, grid->nz);
+    glUniform3f(glGetUniformLocation(program, "uGridMinCenter"),
+                grid->min_center.x, grid->min_center.y, grid->min_center.z);
+    glUniform1f(glGetUniformLocation(program, "uGridStep"), grid->step);
+    glUniform3i(glGetUniformLocation(program, "uBrickDims"),
+                (grid->nx + BIN_BRICK - 1) / BIN_BRICK,
+                (grid->ny + BIN_BRICK - 1) / BIN_BRICK,
+                (grid->nz + BIN_BRICK - 1) / BIN_BRICK);
+    glUniform1ui(glGetUniformLocation(program, "uCap"), field->cap);
+    glUseProgram(0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "gpu field: setup failed\n");
+        gpu_field_destroy(field);
+        return NULL;
+    }
+    return field;
+}
+
+void gpu_field_destroy(GpuField *field) {
+    GLuint bufs[] = {field->command, field->bullets, field->bins,
+                     field->instances, field->active};
+    glDeleteBuffers(5, bufs);
+    glDeleteProgram(field->program);
+    free(field->staging);
+    free(field->bins_staging);
+    free(field);
+}
+
+void gpu_field_eval(GpuField *field, const Sim *sim, const BulletBins *bins) {
+    // the bullet buffer only changes on spawn/despawn, in between the
+    // shader moves the bullets by uTime
+    const Bullets *bullets = &sim->bullets;
+    int count = bullets->live_count;
+    prof_begin(PROF_UPLOAD);
+    if (bullets->version != field->version) {
+        field->version = bullets->version;
+        field->epoch = bullets->time;
+        for (int k = 0; k < count; k++) {
+            int i = bullets->live[k];
+            Vector3 p = bullet_pos(bullets, i, bullets->time);
+            Vector3 v = bullet_velocity(bullets, i);
+            const BulletsHot *h = &bullets->hot;
+            field->staging[k] = (GpuBullet){
+                p.x, p.y, p.z, (float)palette_index(bullets->cold.colors[i]),
+                v.x, v.y, v.z, 0.0f,
+                h->inv_sx[i], h->inv_sy[i], h->inv_sz[i], 0.0f,
+            };
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, field->bullets);
+        if (count > 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                            count * sizeof(GpuBullet), field->staging);
+    }
+
+    // same layout as the bin texture: offsets, then indices
+    int offsets = bins_brick_count(bins) + 1;
+    int len = offsets + bins->index_count;
+    if (len > field->bins_cap) {
+        int cap = field->bins_cap ? field->bins_cap : 1024;
+        while (cap < len)
+            cap *= 2;
+        free(field->bins_staging);
+        field->bins_staging = malloc(cap * sizeof(GLuint));
+        if (!field->bins_staging) {
+            fprintf(stderr, "out of memory growing gpu bins\n");
+            exit(1);
+        }
+        field->bins_cap = cap;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, field->bins);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cap * sizeof(GLuint), NULL,
+                     GL_DYNAMIC_DRAW);
+    }
+    memcpy(field->bins_staging, bins->offsets, offsets * sizeof(GLuint));
+    memcpy(field->bins_staging + offsets, bins->indices,
+           bins->index_count * sizeof(GLuint));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, field->bins);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, len * sizeof(GLuint),
+                    field->bins_staging);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, field->active);
+    if (bins->active_count > 0)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                        bins->active_count * sizeof(GLuint), bins->active);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // a cpu write of the reset command, never a read
+    DrawCommand cmd = {.count = LINE_VERTS_PER_CUBE};
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, field->command);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(cmd), &cmd);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    prof_end(PROF_UPLOAD);
+
+    // nothing to evaluate, the reset command already draws nothing
+    if (bins->active_count == 0)
+        return;
+    // submission only, the dispatch itself runs later on the GPU
+    prof_begin(PROF_FIELD);
+    glUseProgram(field->program);
+    glUniform1f(field->time_loc, (float)(bullets->time - field->epoch));
+    glUniform1ui(field->active_loc, bins->active_count);
+    glUniform1f(field->epsilon_loc, field_epsilon);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, field->command);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, field->bullets);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, field->bins);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, field->instances);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, field->active);
+    // only the cells of active bricks
+    int groups = bins->active_count * (BRICK_CELLS / LOCAL_SIZE);
+    int gx = groups < MAX_GROUPS_X ? groups : MAX_GROUPS_X;
+    glDispatchCompute(gx, (groups + gx - 1) / gx, 1);
+    glUseProgram(0);
+    // the draw consumes the command and the instance stream
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT |
+                    GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    prof_end(PROF_FIELD);
+}
+
+unsigned int gpu_field_instances(const GpuField *field) {
+    return field->instances;
+}
+
+unsigned int gpu_field_command(const GpuField *field) {
+    return field->command;
+}
+
+int gpu_field_capacity(const GpuField *field) { return field->cap; }
@@ -0,0 +1,46 @@
+#ifndef GPUFIELD_H
+#define GPUFIELD_H
+
+#include "bins.h"
+#include "sim.h"
+
+// Field evaluation in a compute shader (field.comp), raw GLES 3.1 / GL 4.3.
+//
+// Every frame the brick lists (BulletBins) are uploaded to an SSBO and one
+// dispatch evaluates every cube of the bricks that have any bullets, brick by
+// brick in Z-order. The live bullets are only re-uploaded when one spawns or
+// despawns: they're stored at that moment's Bullets.time (the time the
+// frame is drawn at) along with their velocity, and the shader moves them by
+// the time since.
+//
+// Lit cubes are appended to an instance buffer of packed CubeInstances
+// (linebatch.h) through an atomic on the instanceCount of an indirect draw
+// command, so the draw reads the count straight from GPU memory and nothing
+// is read back. Bind
+// gpu_field_instances() as the instance stream and gpu_field_command() as
+// GL_DRAW_INDIRECT_BUFFER. The command is a DrawElementsIndirectCommand whose
+// first four words also make a valid DrawArraysIndirectCommand, for vertex
+// pulling.
+//
+// Lit cubes past GPU_FIELD_MAX_INSTANCES are dropped. Cubes blend like
+// BLEND_MAX: the biggest cube wins and takes that bullet's color.
+
+#define GPU_FIELD_MAX_INSTANCES (1 << 20)
+
+typedef struct GpuField GpuField;
+
+// needs a current context. returns NULL if compute shaders aren't available
+// or field.comp doesn't build, callers fall back to cubegrid.vs
+GpuField *gpu_field_create(const Grid *grid, int bullet_cap);
+void gpu_field_destroy(GpuField *field);
+
+// uploads `bins` (built from the same sim) and the live bullets if they
+// changed, and dispatches. leaves the command and instance buffers ready for
+// the draw
+void gpu_field_eval(GpuField *field, const Sim *sim, const BulletBins *bins);
+
+unsigned int gpu_field_instances(const GpuField *field);
+unsigned int gpu_field_command(const GpuField *field);
+int gpu_field_capacity(const GpuField *field);
+
+#endif // GPUFIELD_H
@@ -0,0 +1,133 @@
+#include <GLES3/gl31.h>
+#include <GLES2/gl2ext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "gputimer.h"
+
+struct GpuTimer {
+    GLuint queries[GPU_TIMER_SLOTS][PROF_GPU_COUNT];
+    uint32_t issued[GPU_TIMER_SLOTS]; // passes with a result pending
+    uint64_t frame[GPU_TIMER_SLOTS];  // profiler frame that issued them
+    uint64_t frames;                  // gpu_timer_frame() calls so far
+    int active;                       // pass being timed, or -1
+    int disjoint;                     // GL_GPU_DISJOINT_EXT is there to ask
+};
+
+static int has_extension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+GpuTimer *gpu_timer_create() {
+    const char *env = getenv("CUBE_GPU_TIMERS");
+    if (env && atoi(env) == 0)
+        return NULL;
+    // GL_TIME_ELAPSED and GL_TIME_ELAPSED_EXT are the same enum
+    const char *version = (const char *)glGetString(GL_VERSION);
+    int es = version && strncmp(version, "OpenGL ES", 9) == 0;
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    int disjoint = has_extension("GL_EXT_disjoint_timer_query");
+    int core = !es && (major > 3 || (major == 3 && minor >= 3));
+    if (!disjoint && !core && !has_extension("GL_ARB_timer_query")) {
+        fprintf(stderr, "no GL timer queries, gpu passes won't be timed\n");
+        return NULL;
+    }
+
+    GpuTimer *timer = calloc(1, sizeof(GpuTimer));
+    if (!timer) {
+        fprintf(stderr, "out of memory allocating gpu timer\n");
+        exit(1);
+    }
+    glGenQueries(GPU_TIMER_SLOTS * PROF_GPU_COUNT, &timer->queries[0][0]);
+    timer->active = -1;
+    timer->disjoint = disjoint;
+    return timer;
+}
+
+void gpu_timer_destroy(GpuTimer *timer) {
+    if (!timer)
+        return;
+    glDeleteQueries(GPU_TIMER_SLOTS * PROF_GPU_COUNT, &timer->queries[0][0]);
+    free(timer);
+}
+
+void gpu_timer_frame(GpuTimer *timer) {
+    if (!timer)
+        return;
+    if (timer->active >= 0)
+        gpu_timer_end(timer, timer->active);
+
+    // everything old enough whose result is already there, never waits
+    struct {
+        ProfGpuPass pass;
+        uint64_t frame;
+        GLuint ns;
+    } ready[GPU_TIMER_SLOTS * PROF_GPU_COUNT];
+    int count = 0;
+    for (uint64_t age = GPU_TIMER_SLOTS - 1; age >= GPU_TIMER_LAG; age--) {
+        if (age > timer->frames)
+            continue;
+        int s = (int)((timer->frames - age) % GPU_TIMER_SLOTS);
+        for (int pass = 0; pass < PROF_GPU_COUNT; pass++) {
+            if (!(timer->issued[s] >> pass & 1))
+                continue;
+            GLuint available = 0;
+            GLuint q = timer->queries[s][pass];
+            glGetQueryObjectuiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            ready[count].pass = pass;
+            ready[count].frame = timer->frame[s];
+            glGetQueryObjectuiv(q, GL_QUERY_RESULT, &ready[count].ns);
+            count++;
+            timer->issued[s] &= ~(1u << pass);
+        }
+    }
+    // a disjoint spoils everything in flight, read or not
+    GLint disjoint = 0;
+    if (timer->disjoint)
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        memset(timer->issued, 0, sizeof(timer->issued));
+        count = 0;
+    }
+    for (int i = 0; i < count; i++)
+        prof_gpu(ready[i].pass, ready[i].frame, ready[i].ns);
+
+    // the oldest slot is reused, whatever it still waits for is dropped
+    int s = (int)(timer->frames % GPU_TIMER_SLOTS);
+    timer->issued[s] = 0;
+    timer->frame[s] = prof_frame_index();
+    timer->frames++;
+}
+
+static inline int current_slot(const GpuTimer *timer) {
+    return (int)((timer->frames - 1) % GPU_TIMER_SLOTS);
+}
+
+void gpu_timer_begin(GpuTimer *timer, ProfGpuPass pass) {
+    if (!timer || timer->frames == 0 || timer->active >= 0 ||
+        timer->issued[current_slot(timer)] >> pass & 1)
+        return;
+    glBeginQuery(GL_TIME_ELAPSED_EXT,
+                 timer->queries[current_slot(timer)][pass]);
+    timer->active = pass;
+}
+
+void gpu_timer_end(GpuTimer *timer, ProfGpuPass pass) {
+    if (!timer || timer->active != (int)pass)
+        return;
+    glEndQuery(GL_TIME_ELAPSED_EXT);
+    timer->issued[current_slot(timer)] |= 1u << pass;
+    timer->active = -1;
+}
@@ -0,0 +1,38 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include "profiler.h"
+
+// GPU time of each render pass, through GL_TIME_ELAPSED queries: core in
+// desktop GL 3.3, EXT_disjoint_timer_query on GLES (Mesa exposes it on
+// llvmpipe too).
+//
+// A frame's queries are only read GPU_TIMER_LAG frames later, and only if
+// the GPU already has the results, so reading them never stalls the
+// pipeline. Results that still aren't ready when their slot comes round
+// again are dropped, as are all results in flight when the GPU reports a
+// disjoint (clock change, context loss). Results go to the profiler bound
+// to the calling thread with prof_gpu().
+//
+// Only one pass can be timed at a time (queries of a target can't nest),
+// and a pass is timed once per frame, a second gpu_timer_begin() for it is
+// ignored. Every call takes a NULL timer and does nothing, so callers don't
+// need to care whether timing is available.
+
+#define GPU_TIMER_LAG 3
+#define GPU_TIMER_SLOTS 8 // frames of queries in flight, > GPU_TIMER_LAG
+
+typedef struct GpuTimer GpuTimer;
+
+// needs a current context. returns NULL if the context has no timer queries
+// or CUBE_GPU_TIMERS=0
+GpuTimer *gpu_timer_create();
+void gpu_timer_destroy(GpuTimer *timer);
+
+// call once per frame, inside the profiler frame: collects the finished
+// results of earlier frames and starts a new slot
+void gpu_timer_frame(GpuTimer *timer);
+void gpu_timer_begin(GpuTimer *timer, ProfGpuPass pass);
+void gpu_timer_end(GpuTimer *timer, ProfGpuPass pass);
+
+#endif // GPUTIMER_H
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+//
+#include "linebatch.h"
+
+// corner i sits at center + half * (±1, ±1, ±1), bit 2 = x, 1 = y, 0 = z,
+// same layout as gen_cube_outline()
+static const uint8_t CUBE_EDGES[LINE_VERTS_PER_CUBE] = {
+    // x-positive square
+    0, 1, //
+    1, 3, //
+    3, 2, //
+    2, 0, //
+    // x-negative square
+    4, 5, //
+    5, 7, //
+    7, 6, //
+    6, 4, //
+    // 4 lines connecting them
+    0, 4, //
+    1, 5, //
+    2, 6, //
+    3, 7, //
+};
+
+void line_batch_reserve(LineBatch *batch, int verts) {
+    if (verts <= batch->cap)
+        return;
+    int cap = batch->cap ? batch->cap : LINE_BATCH_MIN_CAP;
+    while (cap < verts)
+        cap *= 2;
+    LineVertex *grown = realloc(batch->verts, cap * sizeof(LineVertex));
+    if (!grown) {
+        fprintf(stderr, "out of memory growing line batch\n");
+        exit(1);
+    }
+    batch->verts = grown;
+    batch->cap = cap;
+}
+
+void line_batch_free(LineBatch *batch) {
+    free(batch->verts);
+    *batch = (LineBatch){0};
+}
+
+static inline uint8_t to_unorm8(float v) {
+    return (uint8_t)(v <= 0.0f ? 0 : v >= 1.0f ? 255 : v * 255.0f + 0.5f);
+}
+
+void line_batch_push_cube(void *user, int cube_idx, Vector3 cube_pos,
+                          float side_len, Vector4 color) {
+    (void)cube_idx;
+    LineBatch *batch = user;
+    line_batch_reserve(batch, batch->count + LINE_VERTS_PER_CUBE);
+
+    float h = side_len / 2.0f;
+    uint8_t r = to_unorm8(color.x), g = to_unorm8(color.y),
+            b = to_unorm8(color.z), a = to_unorm8(color.w);
+    LineVertex corners[8];
+    for (int i = 0; i < 8; i++) {
+        corners[i] = (LineVertex){cube_pos.x + (i & 4 ? -h : h),
+                                  cube_pos.y + (i & 2 ? -h : h),
+                                  cube_pos.z + (i & 1 ? -h : h),
+                                  r, g, b, a};
+    }
+    LineVertex *out = batch->verts + batch->count;
+    for (int i = 0; i < LINE_VERTS_PER_CUBE; i++)
+        out[i] = corners[CUBE_EDGES[i]];
+    batch->count += LINE_VERTS_PER_CUBE;
+}
+
+// ----------- ~%~ instances ~%~ -----------
+
+void instance_batch_reserve(InstanceBatch *batch, int count) {
+    if (count <= batch->cap)
+        return;
+    int cap = batch->cap ? batch->cap : INSTANCE_BATCH_MIN_CAP;
+    while (cap < count)
+        cap *= 2;
+    CubeInstance *grown = realloc(batch->items, cap * sizeof(CubeInstance));
+    if (!grown) {
+        fprintf(stderr, "out of memory growing instance batch\n");
+        exit(1);
+    }
+    batch->items = grown;
+    batch->cap = cap;
+}
+
+void instance_batch_free(InstanceBatch *batch) {
+    free(batch->items);
+    *batch = (InstanceBatch){0};
+}
+
+void instance_batch_push_cube(void *user, int cube_idx, Vector3 cube_pos,
+                              float side_len, Vector4 color) {
+    (void)cube_pos;
+    InstanceBatch *batch = user;
+    instance_batch_reserve(batch, batch->count + 1);
+    int nx = batch->grid->nx, ny = batch->grid->ny;
+    uint32_t x = cube_idx % nx, y = cube_idx / nx % ny,
+             z = cube_idx / (nx * ny);
+    float side = side_len / CUBE_SIZE;
+    side = side <= 0.0f ? 0.0f : side >= 1.0f ? 1.0f : side;
+    batch->items[batch->count++] = (CubeInstance){
+        .cell = x | y << INSTANCE_CELL_BITS | z << 2 * INSTANCE_CELL_BITS,
+        .side_len = (uint16_t)(side * 65535.0f + 0.5f),
+        .color = (uint16_t)palette_index(color),
+    };
+}
+
+// ----------- ~%~ palette ~%~ -----------
+
+// projects onto the gradient, so it's exact for any blend of bullet colors
+int palette_index(Vector4 color) {
+    Vector4 a = BULLET_COLOR_FROM, b = BULLET_COLOR_TO;
+    float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+    float t = ((color.x - a.x) * dx + (color.y - a.y) * dy +
+               (color.z - a.z) * dz) /
+              (dx * dx + dy * dy + dz * dz);
+    t = t <= 0.0f ? 0.0f : t >= 1.0f ? 1.0f : t;
+    return (int)(t * (PALETTE_SIZE - 1) + 0.5f);
+}
+
+void palette_build(uint8_t *rgba) {
+    Vector4 a = BULLET_COLOR_FROM, b = BULLET_COLOR_TO;
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        float t = (float)i / (PALETTE_SIZE - 1);
+        rgba[i * 4 + 0] = to_unorm8(a.x + (b.x - a.x) * t);
+        rgba[i * 4 + 1] = to_unorm8(a.y + (b.y - a.y) * t);
+        rgba[i * 4 + 2] = to_unorm8(a.z + (b.z - a.z) * t);
+        rgba[i * 4 + 3] = to_unorm8(a.w + (b.w - a.w) * t);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef LINEBATCH_H
+#define LINEBATCH_H
+
+#include <stdint.h>
+//
+#include "sim.h"
+
+// CPU staging for the batched wireframe: every visible cube becomes 12 edges
+// (24 GL_LINES vertices) in one persistently allocated array, which is then
+// uploaded and drawn with a single glDrawArrays per frame.
+//
+// The array grows geometrically and is never shrunk, so after warmup a frame
+// does no allocation at all.
+//
+// InstanceBatch is the instanced alternative: one packed 8-byte CubeInstance
+// per visible cube, expanded into the 24 outline vertices by the vertex shader
+// (linecube.vs), so the upload is ~48x smaller. The instance holds the cube's
+// grid cell, its side length as unorm16 and an index into a color palette.
+
+#define LINE_VERTS_PER_CUBE 24
+#define LINE_BATCH_MIN_CAP (1024 * LINE_VERTS_PER_CUBE)
+
+typedef struct LineVertex {
+    float x, y, z;
+    uint8_t r, g, b, a;
+} LineVertex;
+
+typedef struct LineBatch {
+    LineVertex *verts;
+    int count, cap; // in vertices
+} LineBatch;
+
+void line_batch_reserve(LineBatch *batch, int verts);
+void line_batch_free(LineBatch *batch);
+
+static inline void line_batch_clear(LineBatch *batch) { batch->count = 0; }
+
+// CubeEmitFn-compatible, `user` is the LineBatch
+void line_batch_push_cube(void *user, int cube_idx, Vector3 cube_pos,
+                          float side_len, Vector4 color);
+
+#define INSTANCE_BATCH_MIN_CAP 1024
+
+// bits per axis in CubeInstance.cell, enough for GRID_MAX_DIM
+#define INSTANCE_CELL_BITS 10
+#define INSTANCE_CELL_MASK ((1u << INSTANCE_CELL_BITS) - 1)
+
+// colors are quantized onto the BULLET_COLOR_FROM -> BULLET_COLOR_TO
+// gradient. blending only ever averages bullet colors, so cube colors stay on
+// it and the palette loses nothing but precision
+#define PALETTE_SIZE 256
+
+typedef struct CubeInstance {
+    uint32_t cell;     // x | y << 10 | z << 20
+    uint16_t side_len; // unorm16, fraction of CUBE_SIZE
+    uint16_t color;    // palette index
+} CubeInstance;
+
+typedef struct InstanceBatch {
+    CubeInstance *items;
+    int count, cap;   // in instances
+    const Grid *grid; // set by the owner, to split cube indices into xyz
+} InstanceBatch;
+
+void instance_batch_reserve(InstanceBatch *batch, int count);
+void instance_batch_free(InstanceBatch *batch);
+
+static inline void instance_batch_clear(InstanceBatch *batch) {
+    batch->count = 0;
+}
+
+// CubeEmitFn-compatible, `user` is the InstanceBatch
+void instance_batch_push_cube(void *user, int cube_idx, Vector3 cube_pos,
+                              float side_len, Vector4 color);
+
+// nearest palette entry, and the palette itself as PALETTE_SIZE RGBA8 texels
+int palette_index(Vector4 color);
+void palette_build(uint8_t *rgba);
+
+#endif // LINEBATCH_H
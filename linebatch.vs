@@ -0,0 +1,15 @@
+#version 300 es
+precision highp float;
+
+// raylib's default attribute locations, see rlgl.h
+layout (location=0) in vec3 vertexPosition;
+layout (location=3) in vec4 vertexColor;
+
+uniform mat4 mvp;
+
+out vec4 vColor;
+
+void main() {
+    vColor = vertexColor;
+    gl_Position = mvp * vec4(vertexPosition, 1.0);
+}
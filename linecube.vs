@@ -1,12 +1,45 @@
 #version 300 es
 precision highp float;
 
-layout (location=0) in vec3 vertexPosition;   // template cube edge vertex
-layout (location=1) in vec3 instanceCenter;   // per-instance cube center
+// Instanced cube outlines (see CubeInstancesGL in main.c): the 8 corners of a
+// unit cube are indexed into 24 GL_LINES endpoints, every instance places and
+// scales one copy. instances are packed into 8 bytes (CubeInstance in
+// linebatch.h) and decoded here
+#ifdef VERTEX_PULLING
+// vertex pulling (CUBE_PULL=1): nothing but the instance stream is bound, the
+// 24 line endpoints come from gl_VertexID. corner bits 4/2/1 pick -x/-y/-z,
+// same layout and edge order as gen_cube_outline()
+const int CUBE_EDGES[24] = int[24](0, 1, 1, 3, 3, 2, 2, 0, 4, 5, 5, 7, 7, 6,
+                                   6, 4, 0, 4, 1, 5, 2, 6, 3, 7);
+vec3 cubeCorner() {
+    int c = CUBE_EDGES[gl_VertexID];
+    return vec3((c & 4) != 0 ? -0.5 : 0.5, (c & 2) != 0 ? -0.5 : 0.5,
+                (c & 1) != 0 ? -0.5 : 0.5);
+}
+#else
+layout (location=0) in vec3 vertexPosition;   // template cube corner
+vec3 cubeCorner() { return vertexPosition; }
+#endif
+layout (location=1) in uint instanceCell;     // x | y << 10 | z << 20
+layout (location=2) in float instanceSize;    // unorm16, fraction of CUBE_SIZE
+layout (location=3) in uint instanceColor;    // palette index
+
+#define CUBE_SIZE 1.0
+#define CELL_BITS 10u
+#define CELL_MASK 1023u
 
 uniform mat4 mvp;
+uniform vec3 uGridMinCenter;
+uniform float uGridStep;
+uniform lowp sampler2D uPalette;              // PALETTE_SIZE x 1, RGBA8
+
+out vec4 vColor;
 
 void main() {
-    vec3 worldPos = vertexPosition + instanceCenter;
+    uvec3 cell = uvec3(instanceCell, instanceCell >> CELL_BITS,
+                       instanceCell >> (2u * CELL_BITS)) & CELL_MASK;
+    vec3 center = uGridMinCenter + vec3(cell) * uGridStep;
+    vColor = texelFetch(uPalette, ivec2(int(instanceColor), 0), 0);
+    vec3 worldPos = cubeCorner() * (instanceSize * CUBE_SIZE) + center;
     gl_Position = mvp * vec4(worldPos, 1.0);
-}
\ No newline at end of file
+}
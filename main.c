@@ -7,487 +7,1019 @@
 #include <string.h>
 //
 #include "raylib.h"
+#include <GLES3/gl31.h>
 #include "raymath.h"
 #define RLGL_IMPLEMENTATION
 #define GRAPHICS_API_OPENGL_ES3
 #include "rlgl.h"
+//
+#include "bins.h"
+#include "governor.h"
+#include "gpufield.h"
+#include "gputimer.h"
+#include "linebatch.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "profiler.h"
+#include "sim.h"
 
 // ----------- ~%~ macros ~%~ -----------
 
 #define WINDOW_WIDTH 600
 #define WINDOW_HEIGHT 800
 
-#define CENTER ((Vector3){0.0f, 0.0f, 0.0f})
-
-// cube constants
-#define CUBE_SIZE 1.0f
-#define CUBE_PADDING 0.1f
-
-#define CUBES_X 25
-#define CUBES_Y 25
-#define CUBES_Z 25
-#define CUBES_COUNT (CUBES_X * CUBES_Y * CUBES_Z)
-
-// note: SIZE_X is the scaling factor for bullet speed, radius, etc.
-#define GETLENGTH(x) ((CUBE_SIZE + CUBE_PADDING) * (x) - CUBE_PADDING)
-#define SIZE_X GETLENGTH(CUBES_X)
-#define SIZE_Y GETLENGTH(CUBES_Y)
-#define SIZE_Z GETLENGTH(CUBES_Z)
-
-#define X_MIN (CENTER.x - SIZE_X / 2.0f)
-#define X_MAX (CENTER.x + SIZE_X / 2.0f)
-#define Y_MIN (CENTER.y - SIZE_Y / 2.0f)
-#define Y_MAX (CENTER.y + SIZE_Y / 2.0f)
-#define Z_MIN (CENTER.z - SIZE_Z / 2.0f)
-#define Z_MAX (CENTER.z + SIZE_Z / 2.0f)
-
-#define X_MIN_CUBE_CENTER (X_MIN + CUBE_SIZE / 2.0f)
-#define X_MAX_CUBE_CENTER (X_MAX - CUBE_SIZE / 2.0f)
-#define Y_MIN_CUBE_CENTER (Y_MIN + CUBE_SIZE / 2.0f)
-#define Y_MAX_CUBE_CENTER (Y_MAX - CUBE_SIZE / 2.0f)
-#define Z_MIN_CUBE_CENTER (Z_MIN + CUBE_SIZE / 2.0f)
-#define Z_MAX_CUBE_CENTER (Z_MAX - CUBE_SIZE / 2.0f)
-
-#define CUBE_IDX(x, y, z) (CUBES_X * CUBES_Y * (z) + CUBES_X * (y) + (x))
-
-// bullet constants
-#define BULLET_POOL_SIZE 32
-static const float MIN_SPEED = SIZE_X / 5.0f;
-static const float MAX_SPEED = MIN_SPEED * 2.0f;
-
-// we're good here, no scaling necessary
-static const float MIN_SPAWN_DELAY = 0.01f;
-static const float MAX_SPAWN_DELAY = 0.1f;
-
-// how many
-static const float MIN_BULLET_RADIUS = SIZE_X / 15.0f;
-static const float MAX_BULLET_RADIUS = MIN_BULLET_RADIUS * 2.0f;
-
-static const float MIN_BULLET_LEN = SIZE_X / 5.0f;
-static const float MAX_BULLET_LEN = MIN_BULLET_LEN * 2.0f;
-
-#define FREELIST_END BULLET_POOL_SIZE
-#define IS_SPAWNED (BULLET_POOL_SIZE + 1)
-
-// ----------- ~%~ structs ~%~ -----------
-
-typedef struct Bullets {
-    Vector3 positions[BULLET_POOL_SIZE];
-    Vector4 colors[BULLET_POOL_SIZE];
-    Vector3 scales[BULLET_POOL_SIZE];
-    float speeds[BULLET_POOL_SIZE];
-    size_t next_free_or_spawned[BULLET_POOL_SIZE];
-    enum Direction {
-        PX = 0x01,
-        NX = 0x02,
-        PY = 0x04,
-        NY = 0x08,
-        PZ = 0x10,
-        NZ = 0x20,
-        DIR_LEN = 6
-    } directions[BULLET_POOL_SIZE];
-} Bullets;
-
-typedef struct Freelist {
-    size_t head;
-    size_t tail;
-} Freelist;
-
-typedef struct BulletBox {
-    int min_x, max_x, min_y, max_y, min_z, max_z;
-} BulletBox;
+// F2 writes the profiler's frames here, unless --trace names another file
+#define TRACE_KEY KEY_F2
+#define DEFAULT_TRACE_PATH "cube-trace.json"
 
 // ----------- ~%~ fn defs ~%~ -----------
 
-uint32_t next_rand();
-static inline float next_randf(float min, float max);
-static inline int get_xyz(int dir);
-static inline float get_sign(int dir);
-static inline float get_start_pos(int dir);
-static inline float get_random_grid_pos(int dim_count, float min_val);
-static inline int is_out_of_bounds(Vector3 pos, Vector3 scale, int dir);
-static inline int world_to_index(float coord, float base_pos, int max_idx);
-static inline BulletBox get_bullet_bounding_box(Vector3 pos, Vector3 scale);
-static inline void init_freelist(Freelist *frie, Bullets *bullets);
-void free_bullet(Freelist *frie, Bullets *bullets, int idx);
-int spawn_bullet(Freelist *frie, Bullets *bullets);
 Mesh gen_cube_outline(float size);
 
 // ----------- ~%~ main ~%~ -----------
 
-int cpu_render() {
-    // setup data
-    Bullets bullets = {0};
-    Freelist frie = {0};
-    init_freelist(&frie, &bullets);
-
-    // TODO: change this to directly build transforms
-    Vector3 cube_positions[CUBES_COUNT];
-    Vector3 ref_pos = {0.0f, 0.0f, Z_MIN_CUBE_CENTER};
-    for (int z = 0; z < CUBES_Z; z++) {
-        ref_pos.y = Y_MIN_CUBE_CENTER;
-        for (int y = 0; y < CUBES_Y; y++) {
-            ref_pos.x = X_MIN_CUBE_CENTER;
-            for (int x = 0; x < CUBES_X; x++) {
-                cube_positions[CUBE_IDX(x, y, z)] = ref_pos;
-                ref_pos.x += CUBE_SIZE + CUBE_PADDING;
-            }
-            ref_pos.y += CUBE_SIZE + CUBE_PADDING;
+// GPU side of the LineBatch: one VAO/VBO pair that lives for the session
+typedef struct LineBatchGL {
+    unsigned int vao, vbo;
+    int gpu_cap; // in vertices, only ever grows
+    Shader shader;
+    int mvp_loc;
+} LineBatchGL;
+
+static LineBatchGL line_batch_gl_load(int cap) {
+    LineBatchGL gl = {.gpu_cap = cap};
+    gl.shader = LoadShader("linebatch.vs", "cubegrid.fs");
+    if (!IsShaderValid(gl.shader)) {
+        fprintf(stderr, "line batch shader failed to load\n");
+        exit(1);
+    }
+    gl.mvp_loc = GetShaderLocation(gl.shader, "mvp");
+
+    gl.vao = rlLoadVertexArray();
+    rlEnableVertexArray(gl.vao);
+    gl.vbo = rlLoadVertexBuffer(NULL, cap * sizeof(LineVertex), true);
+    rlSetVertexAttribute(0, 3, RL_FLOAT, false, sizeof(LineVertex),
+                         offsetof(LineVertex, x));
+    rlEnableVertexAttribute(0);
+    rlSetVertexAttribute(3, 4, RL_UNSIGNED_BYTE, true, sizeof(LineVertex),
+                         offsetof(LineVertex, r));
+    rlEnableVertexAttribute(3);
+    rlDisableVertexArray();
+    return gl;
+}
+
+static void line_batch_gl_unload(LineBatchGL *gl) {
+    rlUnloadVertexArray(gl->vao);
+    rlUnloadVertexBuffer(gl->vbo);
+    UnloadShader(gl->shader);
+}
+
+// uploads the whole batch and draws it with one glDrawArrays(GL_LINES),
+// must be called inside BeginMode3D() so the camera matrices are current
+static void line_batch_gl_draw(LineBatchGL *gl, const LineBatch *batch) {
+    if (batch->count == 0)
+        return;
+    // flush anything rlgl has queued so draw order is preserved
+    rlDrawRenderBatchActive();
+
+    prof_begin(PROF_UPLOAD);
+    glBindBuffer(GL_ARRAY_BUFFER, gl->vbo);
+    if (batch->cap > gl->gpu_cap) {
+        glBufferData(GL_ARRAY_BUFFER, batch->cap * sizeof(LineVertex), NULL,
+                     GL_DYNAMIC_DRAW);
+        gl->gpu_cap = batch->cap;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->count * sizeof(LineVertex),
+                    batch->verts);
+    prof_end(PROF_UPLOAD);
+
+    Matrix mvp =
+        MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    rlEnableShader(gl->shader.id);
+    rlSetUniformMatrix(gl->mvp_loc, mvp);
+    rlEnableVertexArray(gl->vao);
+    glDrawArrays(GL_LINES, 0, batch->count);
+    rlDisableVertexArray();
+    rlDisableShader();
+}
+
+// GPU side of the instanced renderer. The cube outline from
+// gen_cube_outline() (8 corners, 24 GL_LINES indices) sits in a static VBO and
+// EBO, the InstanceBatch streams into a second VBO with a divisor of 1, and
+// the whole batch goes out in one glDrawElementsInstanced. `grid_vao` binds
+// only the outline, for shaders that place cubes from gl_InstanceID and so
+// have no stream to read (cubegrid.vs), and `compute_vao` streams from the
+// compute field's instance buffer instead. instance colors are looked up in
+// the `palette` texture.
+//
+// With `pulling` set (CUBE_PULL=1) there is no outline VBO/EBO at all: the
+// shaders get VERTEX_PULLING defined and build the 24 endpoints from
+// gl_VertexID, and the draws become glDrawArraysInstanced/Indirect. the VAOs
+// then hold only the instance stream (`grid_vao` holds nothing)
+typedef struct CubeInstancesGL {
+    unsigned int vao, grid_vao, compute_vao;
+    unsigned int outline_vbo, outline_ebo, instance_vbo;
+    unsigned int palette;
+    int pulling;
+    int gpu_cap; // in instances, only ever grows
+    Shader shader;
+    int mvp_loc, palette_loc;
+} CubeInstancesGL;
+
+static void bind_outline(const CubeInstancesGL *gl) {
+    if (gl->pulling)
+        return;
+    rlEnableVertexBuffer(gl->outline_vbo);
+    rlSetVertexAttribute(0, 3, RL_FLOAT, false, 3 * sizeof(float), 0);
+    rlEnableVertexAttribute(0);
+    // element buffer binding is VAO state
+    rlEnableVertexBufferElement(gl->outline_ebo);
+}
+
+// CubeInstance attributes at locations 1-3 from `buffer`, into the bound VAO
+static void bind_instance_stream(unsigned int buffer) {
+    rlEnableVertexBuffer(buffer);
+    // cell and palette index stay integers, rlgl only does float attributes
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(CubeInstance),
+                           (void *)offsetof(CubeInstance, cell));
+    rlSetVertexAttribute(2, 1, RL_UNSIGNED_SHORT, true, sizeof(CubeInstance),
+                         offsetof(CubeInstance, side_len));
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(CubeInstance),
+                           (void *)offsetof(CubeInstance, color));
+    for (int loc = 1; loc <= 3; loc++) {
+        rlEnableVertexAttribute(loc);
+        rlSetVertexAttributeDivisor(loc, 1);
+    }
+}
+
+// LoadShader(), plus VERTEX_PULLING defined in the vertex shader if `pulling`
+static Shader load_cube_shader(const char *vs_path, const char *fs_path,
+                               int pulling) {
+    if (!pulling)
+        return LoadShader(vs_path, fs_path);
+    static const char define[] = "#define VERTEX_PULLING\n";
+    char *vs = LoadFileText(vs_path);
+    char *fs = LoadFileText(fs_path);
+    // #version has to stay the first line
+    char *body = vs ? strchr(vs, '\n') : NULL;
+    if (!body || !fs) {
+        fprintf(stderr, "can't read %s / %s\n", vs_path, fs_path);
+        exit(1);
+    }
+    body++;
+    size_t head = body - vs;
+    char *src = malloc(strlen(vs) + sizeof(define));
+    if (!src) {
+        fprintf(stderr, "out of memory loading %s\n", vs_path);
+        exit(1);
+    }
+    memcpy(src, vs, head);
+    strcpy(src + head, define);
+    strcat(src, body);
+    Shader shader = LoadShaderFromMemory(src, fs);
+    free(src);
+    UnloadFileText(vs);
+    UnloadFileText(fs);
+    return shader;
+}
+
+static CubeInstancesGL cube_instances_gl_load(int cap, const Grid *grid,
+                                              int pulling) {
+    CubeInstancesGL gl = {.gpu_cap = cap, .pulling = pulling};
+    gl.shader = load_cube_shader("linecube.vs", "cubegrid.fs", pulling);
+    if (!IsShaderValid(gl.shader)) {
+        fprintf(stderr, "instanced cube shader failed to load\n");
+        exit(1);
+    }
+    gl.mvp_loc = GetShaderLocation(gl.shader, "mvp");
+    gl.palette_loc = GetShaderLocation(gl.shader, "uPalette");
+    SetShaderValue(gl.shader, GetShaderLocation(gl.shader, "uGridMinCenter"),
+                   &grid->min_center, SHADER_UNIFORM_VEC3);
+    SetShaderValue(gl.shader, GetShaderLocation(gl.shader, "uGridStep"),
+                   &grid->step, SHADER_UNIFORM_FLOAT);
+
+    uint8_t palette[PALETTE_SIZE * 4];
+    palette_build(palette);
+    gl.palette = rlLoadTexture(palette, PALETTE_SIZE, 1,
+                               PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, 1);
+
+    if (!pulling) {
+        Mesh outline = gen_cube_outline(1.0f);
+        gl.outline_vbo = rlLoadVertexBuffer(
+            outline.vertices, outline.vertexCount * 3 * sizeof(float), false);
+        gl.outline_ebo = rlLoadVertexBufferElement(
+            outline.indices, LINE_VERTS_PER_CUBE * sizeof(unsigned short),
+            false);
+        UnloadMesh(outline); // never uploaded, just frees the arrays
+    }
+
+    gl.vao = rlLoadVertexArray();
+    rlEnableVertexArray(gl.vao);
+    bind_outline(&gl);
+    gl.instance_vbo =
+        rlLoadVertexBuffer(NULL, cap * sizeof(CubeInstance), true);
+    bind_instance_stream(gl.instance_vbo);
+    rlDisableVertexArray();
+
+    gl.grid_vao = rlLoadVertexArray();
+    rlEnableVertexArray(gl.grid_vao);
+    bind_outline(&gl);
+    rlDisableVertexArray();
+    return gl;
+}
+
+// draws from `instances` (the compute field's buffer) from now on
+static void cube_instances_gl_attach_compute(CubeInstancesGL *gl,
+                                             unsigned int instances) {
+    gl->compute_vao = rlLoadVertexArray();
+    rlEnableVertexArray(gl->compute_vao);
+    bind_outline(gl);
+    bind_instance_stream(instances);
+    rlDisableVertexArray();
+}
+
+static void cube_instances_gl_unload(CubeInstancesGL *gl) {
+    rlUnloadVertexArray(gl->vao);
+    rlUnloadVertexArray(gl->grid_vao);
+    if (gl->compute_vao)
+        rlUnloadVertexArray(gl->compute_vao);
+    if (!gl->pulling) {
+        rlUnloadVertexBuffer(gl->outline_vbo);
+        rlUnloadVertexBuffer(gl->outline_ebo);
+    }
+    rlUnloadVertexBuffer(gl->instance_vbo);
+    rlUnloadTexture(gl->palette);
+    UnloadShader(gl->shader);
+}
+
+// binds linecube.vs with the current camera and the palette
+static void cube_instances_gl_begin(CubeInstancesGL *gl) {
+    rlDrawRenderBatchActive();
+    Matrix mvp =
+        MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    int palette_unit = 0;
+    rlEnableShader(gl->shader.id);
+    rlSetUniformMatrix(gl->mvp_loc, mvp);
+    rlSetUniform(gl->palette_loc, &palette_unit, RL_SHADER_UNIFORM_INT, 1);
+    glActiveTexture(GL_TEXTURE0 + palette_unit);
+    glBindTexture(GL_TEXTURE_2D, gl->palette);
+}
+
+static void cube_instances_gl_end() {
+    rlDisableVertexArray();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    rlDisableShader();
+}
+
+// uploads the batch and draws every instance in one call, must be called
+// inside BeginMode3D() so the camera matrices are current
+static void cube_instances_gl_draw(CubeInstancesGL *gl,
+                                   const InstanceBatch *batch) {
+    if (batch->count == 0)
+        return;
+    prof_begin(PROF_UPLOAD);
+    glBindBuffer(GL_ARRAY_BUFFER, gl->instance_vbo);
+    if (batch->cap > gl->gpu_cap) {
+        glBufferData(GL_ARRAY_BUFFER, batch->cap * sizeof(CubeInstance), NULL,
+                     GL_DYNAMIC_DRAW);
+        gl->gpu_cap = batch->cap;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, batch->count * sizeof(CubeInstance),
+                    batch->items);
+    prof_end(PROF_UPLOAD);
+
+    cube_instances_gl_begin(gl);
+    rlEnableVertexArray(gl->vao);
+    if (gl->pulling)
+        glDrawArraysInstanced(GL_LINES, 0, LINE_VERTS_PER_CUBE, batch->count);
+    else
+        glDrawElementsInstanced(GL_LINES, LINE_VERTS_PER_CUBE,
+                                GL_UNSIGNED_SHORT, 0, batch->count);
+    cube_instances_gl_end();
+}
+
+// draws the compute field's output, the instance count never leaves the GPU
+static void cube_instances_gl_draw_indirect(CubeInstancesGL *gl,
+                                            unsigned int command) {
+    cube_instances_gl_begin(gl);
+    rlEnableVertexArray(gl->compute_vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command);
+    // the elements command starts with a valid arrays command
+    if (gl->pulling)
+        glDrawArraysIndirect(GL_LINES, 0);
+    else
+        glDrawElementsIndirect(GL_LINES, GL_UNSIGNED_SHORT, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    cube_instances_gl_end();
+}
+
+// draws `instances` outlines with no instance stream, the caller has the
+// shader bound and its uniforms set
+static void cube_instances_gl_draw_grid(const CubeInstancesGL *gl,
+                                        int instances) {
+    rlEnableVertexArray(gl->grid_vao);
+    if (gl->pulling)
+        glDrawArraysInstanced(GL_LINES, 0, LINE_VERTS_PER_CUBE, instances);
+    else
+        glDrawElementsInstanced(GL_LINES, LINE_VERTS_PER_CUBE,
+                                GL_UNSIGNED_SHORT, 0, instances);
+    rlDisableVertexArray();
+}
+
+// bullet table for cubegrid.vs, too big for uniforms once the pool grows:
+// each live bullet is BULLET_TEXELS RGBA32F texels (position, velocity,
+// scale, color), BULLET_TEX_ROW bullets per texture row. keep both in sync
+// with the shader.
+//
+// positions are stored at `epoch` and the shader moves them by uTime =
+// Bullets.time - epoch, so the table only changes when a bullet spawns or
+// despawns, and the float time stays small however long the sim runs
+#define BULLET_TEXELS 4
+#define BULLET_TEX_ROW 256
+
+typedef struct BulletTable {
+    Texture2D tex;
+    Vector4 *texels; // staging, BULLET_TEXELS per bullet
+    unsigned version; // Bullets.version last uploaded
+    double epoch;
+} BulletTable;
+
+static BulletTable bullet_table_load(int cap) {
+    int rows = (cap + BULLET_TEX_ROW - 1) / BULLET_TEX_ROW;
+    BulletTable table = {.version = ~0u};
+    table.texels = calloc((size_t)rows * BULLET_TEX_ROW * BULLET_TEXELS,
+                          sizeof(Vector4));
+    if (!table.texels) {
+        fprintf(stderr, "out of memory allocating bullet table\n");
+        exit(1);
+    }
+    table.tex = (Texture2D){
+        .id = rlLoadTexture(table.texels, BULLET_TEX_ROW * BULLET_TEXELS, rows,
+                            PIXELFORMAT_UNCOMPRESSED_R32G32B32A32, 1),
+        .width = BULLET_TEX_ROW * BULLET_TEXELS,
+        .height = rows,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R32G32B32A32,
+    };
+    return table;
+}
+
+static void bullet_table_unload(BulletTable *table) {
+    rlUnloadTexture(table->tex.id);
+    free(table->texels);
+}
+
+// if a bullet spawned or despawned since the last upload, packs the live
+// bullets densely (in live order, like BulletBins) and uploads only the rows
+// they cover. returns uTime for the shader
+static float bullet_table_upload(BulletTable *table, const Bullets *bullets,
+                                 double time) {
+    if (bullets->version != table->version) {
+        table->version = bullets->version;
+        table->epoch = time;
+        int count = bullets->live_count;
+        for (int k = 0; k < count; k++) {
+            int i = bullets->live[k];
+            Vector3 p = bullet_pos(bullets, i, time);
+            Vector3 v = bullet_velocity(bullets, i);
+            Vector3 s = bullet_scale(bullets, i);
+            Vector4 *t = &table->texels[k * BULLET_TEXELS];
+            t[0] = (Vector4){p.x, p.y, p.z, 1.0f};
+            t[1] = (Vector4){v.x, v.y, v.z, 0.0f};
+            t[2] = (Vector4){s.x, s.y, s.z, 0.0f};
+            t[3] = bullets->cold.colors[i];
         }
-        ref_pos.z += CUBE_SIZE + CUBE_PADDING;
+        int rows = (count + BULLET_TEX_ROW - 1) / BULLET_TEX_ROW;
+        if (rows > 0)
+            rlUpdateTexture(table->tex.id, 0, 0, table->tex.width, rows,
+                            table->tex.format, table->texels);
     }
+    return (float)(time - table->epoch);
+}
+
+// per-brick bullet lists for cubegrid.vs, flattened into one R32F texture of
+// BINS_TEX_ROW texels per row: the brick offsets, then the indices. floats
+// hold every index exactly up to 2^24. the texture grows by whole rows and is
+// never shrunk. keep BINS_TEX_ROW in sync with the shader
+#define BINS_TEX_ROW 1024
+
+typedef struct BinTable {
+    Texture2D tex;
+    float *texels; // staging, tex.width * tex.height
+} BinTable;
+
+static void bin_table_unload(BinTable *table) {
+    if (table->tex.id)
+        rlUnloadTexture(table->tex.id);
+    free(table->texels);
+    *table = (BinTable){0};
+}
+
+// uploads the offsets and indices, only the rows they cover
+static void bin_table_upload(BinTable *table, const BulletBins *bins) {
+    int offsets = bins_brick_count(bins) + 1;
+    int count = offsets + bins->index_count;
+    int rows = (count + BINS_TEX_ROW - 1) / BINS_TEX_ROW;
+    if (rows > table->tex.height) {
+        int cap = table->tex.height ? table->tex.height : 1;
+        while (cap < rows)
+            cap *= 2;
+        bin_table_unload(table);
+        table->texels = calloc((size_t)cap * BINS_TEX_ROW, sizeof(float));
+        if (!table->texels) {
+            fprintf(stderr, "out of memory allocating bin table\n");
+            exit(1);
+        }
+        table->tex = (Texture2D){
+            .id = rlLoadTexture(table->texels, BINS_TEX_ROW, cap,
+                                PIXELFORMAT_UNCOMPRESSED_R32, 1),
+            .width = BINS_TEX_ROW,
+            .height = cap,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R32,
+        };
+    }
+    for (int i = 0; i < offsets; i++)
+        table->texels[i] = (float)bins->offsets[i];
+    for (int i = 0; i < bins->index_count; i++)
+        table->texels[offsets + i] = (float)bins->indices[i];
+    rlUpdateTexture(table->tex.id, 0, 0, BINS_TEX_ROW, rows, table->tex.format,
+                    table->texels);
+}
+
+// stats overlay: bullet count, fps, the governor's quality level (0 is full
+// detail), the process's CPU time per wall-second (every thread, 100% is
+// one core) and the p50/p99 self time of every frame phase, then of every
+// GPU pass that has timings. with the sim pipelined the producer's phases
+// get a block of their own. percentiles are recomputed every HUD_REFRESH
+// frames over the last HUD_WINDOW, not every frame, the CPU load every
+// HUD_CPU_SAMPLE ns
+#define HUD_REFRESH 30
+#define HUD_WINDOW 1024
+#define HUD_FONT 10
+#define HUD_LINE 12
+#define HUD_MAX_PROFS 2
+#define HUD_CPU_SAMPLE 1000000000ull
+
+typedef struct Hud {
+    Profiler *profs[HUD_MAX_PROFS]; // main thread first
+    int prof_count;
+    ProfStats stats[HUD_MAX_PROFS];
+    int age; // frames since the stats were computed
+    uint64_t cpu_wall, cpu_ns; // prof_now() and prof_cpu_now() at the sample
+    float cpu_load;            // over the last sample
+} Hud;
+
+static void hud_row(const char *name, uint32_t p50, uint32_t p99, int x,
+                    int *y, Color color) {
+    *y += HUD_LINE;
+    DrawText(name, x, *y, HUD_FONT, color);
+    DrawText(TextFormat("%.2f", p50 / 1e6), x + 60, *y, HUD_FONT, color);
+    DrawText(TextFormat("%.2f", p99 / 1e6), x + 110, *y, HUD_FONT, color);
+}
 
-    float dt = 0, spawn_timer = next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY);
-    char debug_text[256];
+static void hud_draw(Hud *hud, int bullet_count, int quality) {
+    if (hud->age-- <= 0) {
+        for (int i = 0; i < hud->prof_count; i++)
+            prof_stats(hud->profs[i], HUD_WINDOW, &hud->stats[i]);
+        hud->age = HUD_REFRESH;
+    }
+    uint64_t now = prof_now();
+    if (now - hud->cpu_wall >= HUD_CPU_SAMPLE) {
+        uint64_t cpu = prof_cpu_now();
+        if (hud->cpu_wall)
+            hud->cpu_load = (float)(cpu - hud->cpu_ns) / (now - hud->cpu_wall);
+        hud->cpu_wall = now;
+        hud->cpu_ns = cpu;
+    }
+    int x = 5, y = 5;
+    DrawText(TextFormat("bullets: %d  fps: %d  quality: %d  cpu: %.0f%%",
+                        bullet_count, GetFPS(), quality,
+                        hud->cpu_load * 100.0f),
+             x, y, 16, SKYBLUE);
+    y += 20;
+    DrawText("ms", x, y, HUD_FONT, GRAY);
+    DrawText("p50", x + 60, y, HUD_FONT, GRAY);
+    DrawText("p99", x + 110, y, HUD_FONT, GRAY);
+    for (int i = 0; i < hud->prof_count; i++) {
+        const ProfStats *st = &hud->stats[i];
+        if (i > 0) {
+            y += HUD_LINE;
+            DrawText(hud->profs[i]->name, x, y, HUD_FONT, GRAY);
+        }
+        // phases this thread never runs stay out
+        for (int ph = 0; ph < PROF_PHASE_COUNT; ph++)
+            if (hud->prof_count == 1 || st->p99[ph] > 0)
+                hud_row(prof_phase_name(ph), st->p50[ph], st->p99[ph], x, &y,
+                        SKYBLUE);
+        hud_row("frame", st->frame_p50, st->frame_p99, x, &y, SKYBLUE);
+        for (int pass = 0; pass < PROF_GPU_COUNT; pass++)
+            if (st->gpu_frames[pass] > 0)
+                hud_row(prof_gpu_pass_name(pass), st->gpu_p50[pass],
+                        st->gpu_p99[pass], x, &y, ORANGE);
+    }
+}
 
-    Camera3D camera = {.position = {400.0f, 0.0f, 0.0f},
-                       .target = CENTER,
-                       .up = {0.0f, 1.0f, 0.0f},
-                       .fovy = 5.0f,
-                       .projection = CAMERA_PERSPECTIVE};
+static void write_trace(Hud *hud, const char *path) {
+    if (prof_write_trace(hud->profs, hud->prof_count, path) == 0)
+        fprintf(stderr, "wrote frame trace to %s\n", path);
+}
+
+// the governor's render resolution: below full scale the 3D pass is drawn to
+// an offscreen target of that size and stretched over the window, the HUD
+// still goes on top at full resolution. at full scale nothing changes, it's
+// drawn straight to the window
+typedef struct ScaledView {
+    RenderTexture2D target;
+    int drawing; // to the target this frame
+} ScaledView;
+
+// starts the frame, with `scale` of the window's resolution
+static void scaled_view_begin(ScaledView *view, float scale) {
+    int width = (int)(GetScreenWidth() * scale);
+    int height = (int)(GetScreenHeight() * scale);
+    view->drawing = scale < 1.0f && width > 0 && height > 0;
+    if (!view->drawing) {
+        BeginDrawing();
+        return;
+    }
+    if (view->target.texture.width != width ||
+        view->target.texture.height != height) {
+        if (view->target.id)
+            UnloadRenderTexture(view->target);
+        view->target = LoadRenderTexture(width, height);
+        SetTextureFilter(view->target.texture, TEXTURE_FILTER_BILINEAR);
+    }
+    BeginTextureMode(view->target);
+}
+
+// ends the 3D pass, everything drawn after goes to the window
+static void scaled_view_end(ScaledView *view) {
+    if (!view->drawing)
+        return;
+    EndTextureMode();
+    BeginDrawing();
+    Texture2D tex = view->target.texture;
+    // render textures are upside down
+    DrawTexturePro(tex, (Rectangle){0, 0, tex.width, -tex.height},
+                   (Rectangle){0, 0, GetScreenWidth(), GetScreenHeight()},
+                   (Vector2){0, 0}, 0.0f, WHITE);
+}
+
+static void scaled_view_unload(ScaledView *view) {
+    if (view->target.id)
+        UnloadRenderTexture(view->target);
+}
+
+// feeds the governor a frame and applies the level it picks, to the
+// producer's sim if it's pipelined
+static void govern(Governor *gov, SimPipeline *pipe, Sim *sim, uint64_t wall,
+                   uint64_t busy) {
+    if (pipe) {
+        // the main thread never waits for the producer, it redraws the last
+        // frame instead, so a slow producer doesn't show in the wall time.
+        // its frames still come that late, count them as this frame's
+        uint64_t producer =
+            atomic_load_explicit(&pipe->busy_ns, memory_order_relaxed);
+        wall = wall > producer ? wall : producer;
+        busy = busy > producer ? busy : producer;
+    }
+    if (!governor_frame(gov, wall, busy))
+        return;
+    if (pipe)
+        pipeline_set_quality(pipe, gov->level);
+    else
+        quality_apply(sim, gov->level);
+}
+
+// low-power mode for when nobody's watching. minimized or hidden, the loop
+// stops simulating and drawing and only checks every POWER_POLL seconds
+// whether the window is back. unfocused, it runs at CUBE_IDLE_FPS
+// (DEFAULT_IDLE_FPS, 0 pauses instead) and the camera stops orbiting. the
+// sim catches up with sim_skip() either way, so it picks up where it would
+// have been. every switch is logged with the CPU time per wall-second of
+// the stretch that ended
+#define DEFAULT_IDLE_FPS 10
+#define POWER_POLL 0.1
+
+typedef enum PowerMode { POWER_ACTIVE, POWER_IDLE, POWER_PAUSED } PowerMode;
+
+static const char *POWER_MODE_NAMES[] = {
+    [POWER_ACTIVE] = "active",
+    [POWER_IDLE] = "idle",
+    [POWER_PAUSED] = "paused",
+};
+
+typedef struct Power {
+    PowerMode mode;
+    int active_fps, idle_fps;
+    uint64_t since, since_cpu; // prof_now() and prof_cpu_now() at the switch
+} Power;
+
+static Power power_init(int active_fps) {
+    const char *env = getenv("CUBE_IDLE_FPS");
+    int idle_fps = env ? atoi(env) : DEFAULT_IDLE_FPS;
+    return (Power){.active_fps = active_fps,
+                   .idle_fps = idle_fps > 0 ? idle_fps : 0,
+                   .since = prof_now(),
+                   .since_cpu = prof_cpu_now()};
+}
+
+// switches to the mode the window's state calls for, returns the last one
+static PowerMode power_update(Power *power) {
+    PowerMode mode = IsWindowMinimized() || IsWindowHidden() ? POWER_PAUSED
+                     : IsWindowFocused()                       ? POWER_ACTIVE
+                     : power->idle_fps > 0                     ? POWER_IDLE
+                                                               : POWER_PAUSED;
+    PowerMode last = power->mode;
+    if (mode == last)
+        return last;
+    uint64_t now = prof_now(), cpu = prof_cpu_now();
+    double wall = (now - power->since) / 1e9;
+    fprintf(stderr, "power: %s -> %s after %.1f s, %.3f cpu s per s\n",
+            POWER_MODE_NAMES[last], POWER_MODE_NAMES[mode], wall,
+            wall > 0.0 ? (cpu - power->since_cpu) / 1e9 / wall : 0.0);
+    power->mode = mode;
+    power->since = now;
+    power->since_cpu = cpu;
+    SetTargetFPS(mode == POWER_IDLE ? power->idle_fps : power->active_fps);
+    return last;
+}
+
+// keeps the whole grid in frame, the narrow fov flattens perspective
+static Camera3D grid_camera(const Grid *grid) {
+    float extent = fmaxf(grid->size.x, fmaxf(grid->size.y, grid->size.z));
+    float dist = 400.0f * extent / GETLENGTH(DEFAULT_CUBES);
+    return (Camera3D){.position = {dist, 0.0f, 0.0f},
+                      .target = CENTER,
+                      .up = {0.0f, 1.0f, 0.0f},
+                      .fovy = 5.0f,
+                      .projection = CAMERA_PERSPECTIVE};
+}
+
+int cpu_render(const char *trace_path) {
+    // setup data
+    static Sim sim;
+    sim_init(&sim, grid_init(0, 0, 0), 0);
+    SimClock clock = sim_clock_init(0);
+    FieldPool *pool = pool_create(0);
+    Hud hud = {.profs = {prof_create("main", 1)}, .prof_count = 1};
+    prof_bind(hud.profs[0]);
+
+    Camera3D camera = grid_camera(&sim.grid);
 
     // todo: make resizeable, use window_size as source of truth
     Vector2 window_size = {800, 600};
     InitWindow(window_size.x, window_size.y, "hi");
     SetTargetFPS(GetMonitorRefreshRate(GetCurrentMonitor()));
 
+    LineBatch batch = {0};
+    line_batch_reserve(&batch, LINE_BATCH_MIN_CAP);
+    LineBatchGL batch_gl = line_batch_gl_load(batch.cap);
+    GpuTimer *gpu_timer = gpu_timer_create();
+
     while (!WindowShouldClose()) {
-        dt = GetFrameTime();
-        if ((spawn_timer -= dt) <= 0.0f) {
-            spawn_bullet(&frie, &bullets);
-            spawn_timer = next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY);
-        }
-        // debug: keep track of bullet count
-        int bullet_count = 0;
+        prof_frame_begin();
+        gpu_timer_frame(gpu_timer);
+        sim_update(&sim, &clock, GetFrameTime());
         // debug: visualize cube grid
-        // for (int i = 0; i < CUBES_COUNT; i++) {
-        //     DrawPoint3D(cube_positions[i], WHITE);
+        // for (int i = 0; i < grid_count(&sim.grid); i++) {
+        //     DrawPoint3D(grid_cube_pos_idx(&sim.grid, i), WHITE);
         // }
 
+        // CPU RENDERING
+        prof_begin(PROF_FIELD);
+        pool_eval(pool, &sim);
+        prof_end(PROF_FIELD);
+        prof_begin(PROF_EMIT);
+        line_batch_clear(&batch);
+        pool_for_each_hit(pool, line_batch_push_cube, &batch);
+        prof_end(PROF_EMIT);
+
         // UpdateCamera(&camera, CAMERA_ORBITAL);
+        prof_begin(PROF_DRAW);
         BeginDrawing();
         ClearBackground(BLACK);
         BeginMode3D(camera);
-        for (int i = 0; i < BULLET_POOL_SIZE; i++) {
-            if (bullets.next_free_or_spawned[i] != IS_SPAWNED)
-                continue;
-            bullet_count++;
-
-            int dir = bullets.directions[i];
-            ((float *)&bullets.positions[i])[get_xyz(dir)] +=
-                get_sign(dir) * bullets.speeds[i] * dt;
-            if (is_out_of_bounds(bullets.positions[i], bullets.scales[i],
-                                 dir)) {
-                free_bullet(&frie, &bullets, i);
-                continue;
-            }
-            // debug: visualize bullet positions
-            // DrawSphereEx(bullets.positions[i], CUBE_SIZE / 8.0f, 4, 4,
-            //              ColorFromNormalized(bullets.colors[i]));
-
-            // CPU RENDERING
-
-            BulletBox bbox = get_bullet_bounding_box(bullets.positions[i],
-                                                     bullets.scales[i]);
-            Vector3 *bullet_pos = &bullets.positions[i];
-            for (int z = bbox.min_z; z < bbox.max_z; z++) {
-                for (int y = bbox.min_y; y < bbox.max_y; y++) {
-                    for (int x = bbox.min_x; x < bbox.max_x; x++) {
-                        Vector3 *cube_pos = &cube_positions[CUBE_IDX(x, y, z)];
-                        float dx = fabsf((bullet_pos->x - cube_pos->x) /
-                                         bullets.scales[i].x);
-                        float dy = fabsf((bullet_pos->y - cube_pos->y) /
-                                         bullets.scales[i].y);
-                        float dz = fabsf((bullet_pos->z - cube_pos->z) /
-                                         bullets.scales[i].z);
-                        float d = dx + dy + dz;
-                        float side_len = fmaxf(0.0f, CUBE_SIZE * (1 - d));
-                        if (side_len <= EPSILON)
-                            continue;
-                        // debug: bypass side length calc, show all cubes
-                        // float side_len = CUBE_SIZE;
-                        DrawCubeWires(*cube_pos, side_len, side_len, side_len,
-                                      ColorFromNormalized(bullets.colors[i]));
-                    }
-                }
-            }
-        }
+        // debug: visualize bullet positions
+        // for (int k = 0; k < sim.bullets.live_count; k++) {
+        //     int i = sim.bullets.live[k];
+        //     DrawSphereEx(bullet_cached_pos(&sim.bullets, i),
+        //                  CUBE_SIZE / 8.0f, 4, 4,
+        //                  ColorFromNormalized(sim.bullets.cold.colors[i]));
+        // }
+
+        gpu_timer_begin(gpu_timer, PROF_GPU_CUBES);
+        line_batch_gl_draw(&batch_gl, &batch);
+        gpu_timer_end(gpu_timer, PROF_GPU_CUBES);
         EndMode3D();
-        // debug: show stats
-        sprintf(debug_text, "bullets: %d\nfps: %d", bullet_count, GetFPS());
-        DrawText(debug_text, 5, 5, 16, SKYBLUE);
+        // flushed here rather than in EndDrawing(), to time it
+        gpu_timer_begin(gpu_timer, PROF_GPU_HUD);
+        hud_draw(&hud, sim.bullet_count, 0);
+        rlDrawRenderBatchActive();
+        gpu_timer_end(gpu_timer, PROF_GPU_HUD);
+        prof_end(PROF_DRAW);
+        prof_begin(PROF_PRESENT);
         EndDrawing();
+        prof_end(PROF_PRESENT);
+        prof_frame_end();
+        if (IsKeyPressed(TRACE_KEY))
+            write_trace(&hud, trace_path ? trace_path : DEFAULT_TRACE_PATH);
     }
+    if (trace_path)
+        write_trace(&hud, trace_path);
+    prof_destroy(hud.profs[0]);
+    gpu_timer_destroy(gpu_timer);
+    line_batch_gl_unload(&batch_gl);
+    line_batch_free(&batch);
+    pool_destroy(pool);
+    sim_free(&sim);
     CloseWindow();
     return 0;
 }
 
-int gpu_render() {
+// one instanced draw per frame, CUBE_EVAL picks where the field comes from:
+//  cpu (default): the pool evaluates it, lit cubes are streamed as instances
+//  gpu: field.comp evaluates it and appends lit cubes on the GPU, drawn
+//       indirectly. falls back to vs without compute shaders
+//  vs: every grid cube is drawn and cubegrid.vs evaluates the bullets binned
+//      into its brick
+// CUBE_PULL=1 builds the outlines from gl_VertexID instead of a mesh.
+// with cpu evaluation the sim and field run a frame ahead on a producer
+// thread (pipeline.h), CUBE_PIPELINE=0 runs them inline instead.
+// the quality governor (governor.h) trades detail for frame rate unless
+// CUBE_GOVERNOR=0, or a spawn trace is replayed: that keeps its workload.
+// hidden, minimized or unfocused windows throttle down, see Power
+typedef enum EvalMode { EVAL_CPU, EVAL_COMPUTE, EVAL_VS } EvalMode;
+
+int gpu_render(const char *trace_path) {
     // setup data
-    Bullets bullets = {0};
-    Freelist frie = {0};
-    init_freelist(&frie, &bullets);
-
-    Matrix transforms[CUBES_COUNT];
-    Vector3 ref_pos = {0.0f, 0.0f, Z_MIN_CUBE_CENTER};
-    for (int z = 0; z < CUBES_Z; z++) {
-        ref_pos.y = Y_MIN_CUBE_CENTER;
-        for (int y = 0; y < CUBES_Y; y++) {
-            ref_pos.x = X_MIN_CUBE_CENTER;
-            for (int x = 0; x < CUBES_X; x++) {
-                transforms[CUBE_IDX(x, y, z)] =
-                    MatrixTranslate(ref_pos.x, ref_pos.y, ref_pos.z);
-                ref_pos.x += CUBE_SIZE + CUBE_PADDING;
-            }
-            ref_pos.y += CUBE_SIZE + CUBE_PADDING;
-        }
-        ref_pos.z += CUBE_SIZE + CUBE_PADDING;
-    }
-
-    float dt = 0, spawn_timer = next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY);
-    char debug_text[256];
-
-    Camera3D camera = {.position = {400.0f, 0.0f, 0.0f},
-                       .target = CENTER,
-                       .up = {0.0f, 1.0f, 0.0f},
-                       .fovy = 5.0f,
-                       .projection = CAMERA_PERSPECTIVE};
+    static Sim sim;
+    sim_init(&sim, grid_init(0, 0, 0), 0);
+    SimClock clock = sim_clock_init(0);
+    const char *eval = getenv("CUBE_EVAL");
+    EvalMode mode = !eval                    ? EVAL_CPU
+                    : strcmp(eval, "gpu") == 0 ? EVAL_COMPUTE
+                    : strcmp(eval, "vs") == 0  ? EVAL_VS
+                                               : EVAL_CPU;
+    FieldPool *pool = mode == EVAL_CPU ? pool_create(0) : NULL;
+    const char *pull = getenv("CUBE_PULL");
+    int pulling = pull && atoi(pull) != 0;
+    const char *pipeline = getenv("CUBE_PIPELINE");
+    int pipelined = mode == EVAL_CPU && !(pipeline && atoi(pipeline) == 0);
+    SimPipeline *pipe = pipelined ? pipeline_start(&sim, pool) : NULL;
+    Hud hud = {.profs = {prof_create("main", 1)}, .prof_count = 1};
+    prof_bind(hud.profs[0]);
+    if (pipe)
+        hud.profs[hud.prof_count++] = pipe->prof;
+
+    Camera3D camera = grid_camera(&sim.grid);
 
     // todo: make resizeable, use window_size as source of truth
     Vector2 window_size = {800, 600};
+    // without it raylib sits in glfwWaitEvents() while the window is
+    // minimized, and the loop never gets to see that it is
+    SetConfigFlags(FLAG_WINDOW_ALWAYS_RUN);
     InitWindow(window_size.x, window_size.y, "hi");
-    SetTargetFPS(GetMonitorRefreshRate(GetCurrentMonitor()));
-    Mesh cube = gen_cube_outline(1.0f);
-    Model cube_model = LoadModelFromMesh(cube);
-
-    Shader shader = LoadShader("cubegrid.vs", "cubegrid.fs");
-    // cube_model.materials[0].shader = shader;
-    int vao = rlLoadVertexArray();
-    int transforms_ssbo = rlLoadShaderBuffer(sizeof(transforms), transforms, NULL);
-    rlUnloadVertexArray(vao);
+    int refresh = GetMonitorRefreshRate(GetCurrentMonitor());
+    SetTargetFPS(refresh);
+    Governor gov = governor_init(refresh);
+    gov.enabled = gov.enabled && !sim.replay;
+    Power power = power_init(refresh);
+    ScaledView view = {0};
+
+    InstanceBatch batch = {.grid = &sim.grid};
+    instance_batch_reserve(&batch, INSTANCE_BATCH_MIN_CAP);
+    CubeInstancesGL cubes_gl =
+        cube_instances_gl_load(batch.cap, &sim.grid, pulling);
+    GpuField *gpu_field = NULL;
+    if (mode == EVAL_COMPUTE) {
+        gpu_field = gpu_field_create(&sim.grid, sim.bullets.cap);
+        if (gpu_field) {
+            cube_instances_gl_attach_compute(&cubes_gl,
+                                             gpu_field_instances(gpu_field));
+        } else {
+            fprintf(stderr, "no compute field, falling back to cubegrid.vs\n");
+            mode = EVAL_VS;
+        }
+    }
+    GpuTimer *gpu_timer = gpu_timer_create();
 
+    Shader shader = load_cube_shader("cubegrid.vs", "cubegrid.fs", pulling);
     if (!IsShaderValid(shader)) {
         fprintf(stderr, "shader did an oopsie woopsie\n");
         exit(1);
     }
-
+    BulletTable table = bullet_table_load(sim.bullets.cap);
+    BulletBins bins;
+    bins_init(&bins, &sim.grid);
+    BinTable bin_table = {0};
+    int mvp_loc = GetShaderLocation(shader, "mvp");
+    int grid_dims[3] = {sim.grid.nx, sim.grid.ny, sim.grid.nz};
+    int brick_dims[3] = {bins.bx, bins.by, bins.bz};
+    int time_loc = GetShaderLocation(shader, "uTime");
+    int bullets_unit = 0, bins_unit = 1;
+    SetShaderValue(shader, GetShaderLocation(shader, "uGridDims"), grid_dims,
+                   SHADER_UNIFORM_IVEC3);
+    SetShaderValue(shader, GetShaderLocation(shader, "uGridMinCenter"),
+                   &sim.grid.min_center, SHADER_UNIFORM_VEC3);
+    SetShaderValue(shader, GetShaderLocation(shader, "uGridStep"),
+                   &sim.grid.step, SHADER_UNIFORM_FLOAT);
+    SetShaderValue(shader, GetShaderLocation(shader, "uBrickDims"),
+                   brick_dims, SHADER_UNIFORM_IVEC3);
+    SetShaderValue(shader, GetShaderLocation(shader, "uBullets"),
+                   &bullets_unit, SHADER_UNIFORM_INT);
+    SetShaderValue(shader, GetShaderLocation(shader, "uBins"), &bins_unit,
+                   SHADER_UNIFORM_INT);
+
+    uint64_t frame_start = prof_now(), frame_end = frame_start;
+    // what the screen shows: the grid was empty, from this camera
+    int shown_visible = -1, unshown = 0;
+    Camera3D shown_camera = camera;
     while (!WindowShouldClose()) {
-        dt = GetFrameTime();
-        if ((spawn_timer -= dt) <= 0.0f) {
-            spawn_bullet(&frie, &bullets);
-            spawn_timer = next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY);
+        // input was polled at the end of the last pass, whichever it took
+        if (IsKeyPressed(TRACE_KEY))
+            write_trace(&hud, trace_path ? trace_path : DEFAULT_TRACE_PATH);
+        PowerMode last = power_update(&power);
+        if (power.mode == POWER_PAUSED) {
+            WaitTime(POWER_POLL);
+            PollInputEvents();
+            continue;
+        }
+        uint64_t now = prof_now();
+        double dt = (now - frame_start) / 1e9;
+        frame_start = now;
+        // idle frames are further apart than the tick budget covers, and the
+        // first one back from a pause is a whole pause late. so is any frame
+        // after a stall (a debugger, a suspend): sim_update() would drop all
+        // but its first clock.max_ticks
+        int resumed = power.mode != POWER_ACTIVE || last != POWER_ACTIVE;
+        int catch_up = resumed || dt > clock.max_ticks * clock.tick;
+
+        prof_frame_begin();
+        gpu_timer_frame(gpu_timer);
+        // the pipelined frame is ready-made, only drawn here
+        const InstanceBatch *cubes = &batch;
+        int bullet_count, visible_count;
+        if (pipe) {
+            if (catch_up)
+                pipeline_skip_next(pipe);
+            const PipelineFrame *frame = pipeline_acquire(pipe);
+            cubes = &frame->batch;
+            bullet_count = frame->bullet_count;
+            visible_count = frame->visible_count;
+        } else {
+            if (catch_up)
+                sim_skip(&sim, &clock, dt);
+            else
+                sim_update(&sim, &clock, (float)dt);
+            bullet_count = sim.bullet_count;
+            visible_count = sim.visible_count;
         }
 
-        // smaller arrays that only hold valid bullet data
-        Vector3 bulletPos[BULLET_POOL_SIZE] = {0};
-        Vector3 bulletScale[BULLET_POOL_SIZE] = {0};
-        Vector4 bulletColor[BULLET_POOL_SIZE] = {0};
-
-        int bullet_count = 0;
-
-        for (int i = 0; i < BULLET_POOL_SIZE; i++) {
-            if (bullets.next_free_or_spawned[i] != IS_SPAWNED)
-                continue;
-            bullet_count++;
-
-            int dir = bullets.directions[i];
-            ((float *)&bullets.positions[i])[get_xyz(dir)] +=
-                get_sign(dir) * bullets.speeds[i] * dt;
-            if (is_out_of_bounds(bullets.positions[i], bullets.scales[i],
-                                 dir)) {
-                free_bullet(&frie, &bullets, i);
-                continue;
-            }
-            bulletPos[bullet_count] = bullets.positions[i];
-            bulletScale[bullet_count] = bullets.scales[i];
-            bulletColor[bullet_count] = bullets.colors[i];
+        switch (mode) {
+        case EVAL_CPU:
+            if (pipe)
+                break;
+            prof_begin(PROF_FIELD);
+            pool_eval(pool, &sim);
+            prof_end(PROF_FIELD);
+            prof_begin(PROF_EMIT);
+            instance_batch_clear(&batch);
+            pool_for_each_hit(pool, instance_batch_push_cube, &batch);
+            prof_end(PROF_EMIT);
+            break;
+        case EVAL_COMPUTE:
+            prof_begin(PROF_FIELD);
+            bins_build(&bins, &sim);
+            prof_end(PROF_FIELD);
+            gpu_timer_begin(gpu_timer, PROF_GPU_FIELD);
+            gpu_field_eval(gpu_field, &sim, &bins);
+            gpu_timer_end(gpu_timer, PROF_GPU_FIELD);
+            break;
+        case EVAL_VS: {
+            prof_begin(PROF_UPLOAD);
+            float time =
+                bullet_table_upload(&table, &sim.bullets, sim.bullets.time);
+            SetShaderValue(shader, time_loc, &time, SHADER_UNIFORM_FLOAT);
+            prof_end(PROF_UPLOAD);
+            prof_begin(PROF_FIELD);
+            bins_build(&bins, &sim);
+            prof_end(PROF_FIELD);
+            prof_begin(PROF_UPLOAD);
+            bin_table_upload(&bin_table, &bins);
+            prof_end(PROF_UPLOAD);
+            break;
+        }
         }
 
-        
-        SetShaderValue(shader, GetShaderLocation(shader, "uBulletCount"),
-                       &bullet_count, SHADER_UNIFORM_INT);
-        SetShaderValueV(shader, GetShaderLocation(shader, "uBulletPos"),
-                        bulletPos, SHADER_UNIFORM_VEC3, bullet_count);
-        SetShaderValueV(shader, GetShaderLocation(shader, "uBulletScale"),
-                        bulletScale, SHADER_UNIFORM_VEC3, bullet_count);
-        SetShaderValueV(shader, GetShaderLocation(shader, "uBulletColor"),
-                        bulletColor, SHADER_UNIFORM_VEC4, bullet_count);
-
-        UpdateCamera(&camera, CAMERA_ORBITAL);
-        BeginDrawing();
+        if (power.mode == POWER_ACTIVE)
+            UpdateCamera(&camera, CAMERA_ORBITAL);
+        // an empty grid that was empty last frame too, from the same camera,
+        // is already on screen. the HUD still gets a redraw every HUD_REFRESH
+        if (visible_count == 0 && shown_visible == 0 &&
+            memcmp(&camera, &shown_camera, sizeof(camera)) == 0 &&
+            ++unshown < HUD_REFRESH) {
+            prof_frame_end();
+            int fps = power.mode == POWER_IDLE ? power.idle_fps : refresh;
+            WaitTime(1.0 / (fps > 0 ? fps : 60));
+            PollInputEvents();
+            frame_end = prof_now();
+            continue;
+        }
+        shown_visible = visible_count;
+        shown_camera = camera;
+        unshown = 0;
+
+        prof_begin(PROF_DRAW);
+        scaled_view_begin(&view, quality_levels[gov.level].res_scale);
         ClearBackground(BLACK);
         BeginMode3D(camera);
-        // DrawModel(cube_model, (Vector3){0,0,0}, 1.0f, RED);
-        DrawMesh(cube, cube_model.materials[0], MatrixScale(6.0f, 6.0f, 6.0f));
-        // DrawMeshInstanced(cube, cube_model.materials[0], transforms,
-        //                   CUBES_COUNT);
+        gpu_timer_begin(gpu_timer, PROF_GPU_CUBES);
+        if (mode == EVAL_VS) {
+            rlDrawRenderBatchActive();
+            Matrix mvp = MatrixMultiply(rlGetMatrixModelview(),
+                                        rlGetMatrixProjection());
+            rlEnableShader(shader.id);
+            rlSetUniformMatrix(mvp_loc, mvp);
+            glActiveTexture(GL_TEXTURE0 + bins_unit);
+            glBindTexture(GL_TEXTURE_2D, bin_table.tex.id);
+            glActiveTexture(GL_TEXTURE0 + bullets_unit);
+            glBindTexture(GL_TEXTURE_2D, table.tex.id);
+            cube_instances_gl_draw_grid(&cubes_gl, grid_count(&sim.grid));
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0 + bins_unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+            rlDisableShader();
+        } else if (mode == EVAL_COMPUTE) {
+            cube_instances_gl_draw_indirect(&cubes_gl,
+                                            gpu_field_command(gpu_field));
+        } else {
+            cube_instances_gl_draw(&cubes_gl, cubes);
+        }
+        gpu_timer_end(gpu_timer, PROF_GPU_CUBES);
         EndMode3D();
-        rlEnd();
-        // debug: show stats
-        sprintf(debug_text, "bullets: %d\nfps: %d", bullet_count, GetFPS());
-        DrawText(debug_text, 5, 5, 16, SKYBLUE);
+        scaled_view_end(&view);
+        // flushed here rather than in EndDrawing(), to time it
+        gpu_timer_begin(gpu_timer, PROF_GPU_HUD);
+        hud_draw(&hud, bullet_count, gov.level);
+        rlDrawRenderBatchActive();
+        gpu_timer_end(gpu_timer, PROF_GPU_HUD);
+        prof_end(PROF_DRAW);
+        prof_begin(PROF_PRESENT);
+        uint64_t present = prof_now();
         EndDrawing();
+        prof_end(PROF_PRESENT);
+        prof_frame_end();
+        // whatever EndDrawing() spent waiting isn't load, and frames that
+        // aren't paced for the refresh rate aren't the governor's business
+        uint64_t end = prof_now();
+        if (!resumed)
+            govern(&gov, pipe, &sim, end - frame_end, present - frame_end);
+        frame_end = end;
     }
 
+    if (trace_path)
+        write_trace(&hud, trace_path);
+    // hands sim and pool back
+    if (pipe)
+        pipeline_stop(pipe);
+    prof_destroy(hud.profs[0]);
+    gpu_timer_destroy(gpu_timer);
+    scaled_view_unload(&view);
     UnloadShader(shader);
-    UnloadModel(cube_model); // unloads associated meshes
+    bullet_table_unload(&table);
+    bin_table_unload(&bin_table);
+    bins_free(&bins);
+    if (gpu_field)
+        gpu_field_destroy(gpu_field);
+    cube_instances_gl_unload(&cubes_gl);
+    instance_batch_free(&batch);
+    if (pool)
+        pool_destroy(pool);
+    sim_free(&sim);
     CloseWindow();
     return 0;
 }
 
-int main() { return gpu_render(); }
-
-// ----------- ~%~ helper fn's ~%~ -----------
-
-// todo: feed some unique value to this at runtime?
-#define DEFAULT_SEED 12345
-#define XOR_MAGIC 0x2545F4914F6CDD1D
-static uint32_t xorshift_state = DEFAULT_SEED;
-
-// xorshift32
-uint32_t next_rand() {
-    uint32_t x = xorshift_state;
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    xorshift_state = x;
-    return x;
-}
-
-static inline float next_randf(float min, float max) {
-    return min + (max - min) * (float)next_rand() / (float)UINT32_MAX;
-}
-
-static inline int get_xyz(int dir) {
-    return dir & (PX | NX) ? 0 : dir & (PY | NY) ? 1 : 2;
-}
-
-static inline float get_sign(int dir) {
-    return dir & (PX | PY | PZ) ? 1.0f : -1.0f;
-}
-
-// todo: refactor so we include the scale offset here, will probably look nicer
-static inline float get_start_pos(int dir) {
-    switch (dir) {
-    case NX:
-        return X_MAX;
-    case PX:
-        return X_MIN;
-    case NY:
-        return Y_MAX;
-    case PY:
-        return Y_MIN;
-    case NZ:
-        return Z_MAX;
-    case PZ:
-        return Z_MIN;
-    default:
-        __builtin_unreachable();
-    }
-}
-
-static inline float get_random_grid_pos(int dim_count, float min_val) {
-    return min_val +
-           (float)(next_rand() % dim_count) * (CUBE_SIZE + CUBE_PADDING);
-}
-
-static inline int is_out_of_bounds(Vector3 pos, Vector3 scale, int dir) {
-    switch (dir) {
-    case PX:
-        return pos.x > (X_MAX + scale.x);
-    case NX:
-        return pos.x < (X_MIN - scale.x);
-    case PY:
-        return pos.y > (Y_MAX + scale.y);
-    case NY:
-        return pos.y < (Y_MIN - scale.y);
-    case PZ:
-        return pos.z > (Z_MAX + scale.z);
-    case NZ:
-        return pos.z < (Z_MIN - scale.z);
+// usage: ./main [--trace path]
+// --trace writes the profiler's last PROF_FRAMES frames to `path` as a Chrome
+// trace on exit (and on F2, which otherwise writes DEFAULT_TRACE_PATH)
+int main(int argc, char **argv) {
+    const char *trace_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--trace path]\n", argv[0]);
+            return 1;
+        }
     }
-    return 1;
-}
-
-static inline int world_to_index(float coord, float base_pos, int max_idx) {
-    // NOTE: idk why ceilf had to be used here but it fixed an off by -1 offset
-    // issue.
-    int ret = (int)ceilf((coord - base_pos) / (CUBE_SIZE + CUBE_PADDING));
-    return ret > max_idx ? max_idx : ret < 0 ? 0 : ret;
-}
-
-static inline BulletBox get_bullet_bounding_box(Vector3 pos, Vector3 scale) {
-    return (BulletBox){
-        .min_x = world_to_index(pos.x - scale.x, X_MIN_CUBE_CENTER, CUBES_X),
-        .max_x = world_to_index(pos.x + scale.x, X_MIN_CUBE_CENTER, CUBES_X),
-        .min_y = world_to_index(pos.y - scale.y, Y_MIN_CUBE_CENTER, CUBES_Y),
-        .max_y = world_to_index(pos.y + scale.y, Y_MIN_CUBE_CENTER, CUBES_Y),
-        .min_z = world_to_index(pos.z - scale.z, Z_MIN_CUBE_CENTER, CUBES_Z),
-        .max_z = world_to_index(pos.z + scale.z, Z_MIN_CUBE_CENTER, CUBES_Z),
-    };
-}
-
-// ----------- ~%~ spawn logic ~%~ -----------
-
-static inline void init_freelist(Freelist *frie, Bullets *bullets) {
-    for (size_t i = 0; i < BULLET_POOL_SIZE - 1; i++)
-        bullets->next_free_or_spawned[i] = i + 1;
-    bullets->next_free_or_spawned[BULLET_POOL_SIZE - 1] = FREELIST_END;
-    frie->head = 0;
-    frie->tail = BULLET_POOL_SIZE - 1;
+    return gpu_render(trace_path);
 }
 
-void free_bullet(Freelist *frie, Bullets *bullets, int idx) {
-    bullets->positions[idx] = (Vector3){
-        FLT_MAX, FLT_MAX, FLT_MAX}; // prevent random background stutters
-    bullets->next_free_or_spawned[idx] = FREELIST_END;
-    if (frie->tail != FREELIST_END)
-        bullets->next_free_or_spawned[frie->tail] = idx;
-    else
-        frie->head = idx;
-    frie->tail = idx;
-}
-
-// returns index if bullet is spawned, BULLET_POOL_SIZE if not
-int spawn_bullet(Freelist *frie, Bullets *bullets) {
-    // get next free bullet, if one is available, bail otherwise
-    if (frie->head == FREELIST_END)
-        return FREELIST_END;
-    size_t idx = frie->head;
-    frie->head = bullets->next_free_or_spawned[idx];
-    if (frie->head == FREELIST_END)
-        frie->tail = FREELIST_END;
-    bullets->next_free_or_spawned[idx] = IS_SPAWNED;
-
-    // initialize bullet data
-
-    bullets->colors[idx] = Vector4Lerp(
-        (Vector4){0xC7 / 255.0f, 0x51 / 255.0f, 0x08 / 255.0f, 1.0f},
-        (Vector4){0x61 / 255.0f, 0x0C / 255.0f, 0xCF / 255.0f, 1.0f},
-        next_randf(0.0f, 1.0f));
-    bullets->directions[idx] = 1 << (next_rand() % DIR_LEN);
-
-    bullets->speeds[idx] = next_randf(MIN_SPEED, MAX_SPEED);
-    float bullet_radius = next_randf(MIN_BULLET_RADIUS, MAX_BULLET_RADIUS);
-    bullets->scales[idx] =
-        (Vector3){bullet_radius, bullet_radius, bullet_radius};
-    bullets->positions[idx] =
-        (Vector3){get_random_grid_pos(CUBES_X, X_MIN_CUBE_CENTER),
-                  get_random_grid_pos(CUBES_Y, Y_MIN_CUBE_CENTER),
-                  get_random_grid_pos(CUBES_Z, Z_MIN_CUBE_CENTER)};
-
-    // grab x,y,z offset so we can point to the relevant axis across multiple
-    // Vector3's when they're casted to float*
-    int xyz_idx = get_xyz(bullets->directions[idx]);
-
-    float *scale_xyz = &((float *)&bullets->scales[idx])[xyz_idx];
-    *scale_xyz = next_randf(MIN_BULLET_LEN, MAX_BULLET_LEN);
-
-    ((float *)&bullets->positions[idx])[xyz_idx] =
-        get_start_pos(bullets->directions[idx]) -
-        (*scale_xyz) * get_sign(bullets->directions[idx]);
-    return idx;
-}
+// ----------- ~%~ mesh ~%~ -----------
 
 // NOTE: needs to be drawn with GL_LINES primitive
 Mesh gen_cube_outline(float size) {
@@ -529,16 +1061,3 @@ Mesh gen_cube_outline(float size) {
     return mesh;
 }
 
-/*
-
-Index Space -> World Space
-
-
-Octahedron equation: |x / scale_x| + |y / scale_y| + |z / scale_z| <= 1
-
-d = |(bul_x - cube_x) / scale_x| + |(bul_y - cube_y) / scale_y| + |(bul_z -
-cube_z) / scale_z|
-
-side_len = maxf(0.0f, CUBE_SIZE * (1 - d))
-
-*/
\ No newline at end of file
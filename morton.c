@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+//
+#include "morton.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MORTON_X86 1
+#endif
+
+#define MORTON_MASK_X 0x09249249u // every third bit from bit 0, 10 bits
+
+// ----------- ~%~ tables ~%~ -----------
+
+// spread[b]: the 8 bits of b moved to every third bit
+static uint32_t spread[256];
+// gather[c]: the 9 bits of c pulled apart into x | y << 3 | z << 6
+static uint16_t gather[512];
+static int tables_ready;
+
+static void build_tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t s = 0;
+        for (int i = 0; i < 8; i++)
+            s |= (b >> i & 1) << (3 * i);
+        spread[b] = s;
+    }
+    for (uint32_t c = 0; c < 512; c++) {
+        uint32_t x = 0, y = 0, z = 0;
+        for (int i = 0; i < 3; i++) {
+            x |= (c >> (3 * i) & 1) << i;
+            y |= (c >> (3 * i + 1) & 1) << i;
+            z |= (c >> (3 * i + 2) & 1) << i;
+        }
+        gather[c] = (uint16_t)(x | y << 3 | z << 6);
+    }
+    tables_ready = 1;
+}
+
+static inline uint32_t spread10(uint32_t v) {
+    return spread[v & 0xff] | spread[v >> 8 & 0x3] << 24;
+}
+
+static uint32_t encode_table(uint32_t x, uint32_t y, uint32_t z) {
+    return spread10(x) | spread10(y) << 1 | spread10(z) << 2;
+}
+
+// 9 code bits (3 per axis) at a time
+static void decode_table(uint32_t code, uint32_t *x, uint32_t *y,
+                         uint32_t *z) {
+    uint32_t rx = 0, ry = 0, rz = 0;
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += 9) {
+        uint32_t g = gather[code >> shift & 511];
+        int at = shift / 3;
+        rx |= (g & 7) << at;
+        ry |= (g >> 3 & 7) << at;
+        rz |= (g >> 6 & 7) << at;
+    }
+    *x = rx;
+    *y = ry;
+    *z = rz;
+}
+
+// ----------- ~%~ bmi2 ~%~ -----------
+
+#ifdef MORTON_X86
+
+__attribute__((target("bmi2"))) static uint32_t
+encode_bmi2(uint32_t x, uint32_t y, uint32_t z) {
+    return _pdep_u32(x, MORTON_MASK_X) | _pdep_u32(y, MORTON_MASK_X << 1) |
+           _pdep_u32(z, MORTON_MASK_X << 2);
+}
+
+__attribute__((target("bmi2"))) static void
+decode_bmi2(uint32_t code, uint32_t *x, uint32_t *y, uint32_t *z) {
+    *x = _pext_u32(code, MORTON_MASK_X);
+    *y = _pext_u32(code, MORTON_MASK_X << 1);
+    *z = _pext_u32(code, MORTON_MASK_X << 2);
+}
+
+#endif // MORTON_X86
+
+// ----------- ~%~ dispatch ~%~ -----------
+
+uint32_t (*morton_encode)(uint32_t x, uint32_t y, uint32_t z) = encode_table;
+void (*morton_decode)(uint32_t code, uint32_t *x, uint32_t *y,
+                      uint32_t *z) = decode_table;
+static const char *impl_name = "table";
+
+void morton_init() {
+    if (!tables_ready)
+        build_tables();
+    const char *want = getenv("CUBE_KERNEL");
+    morton_encode = encode_table;
+    morton_decode = decode_table;
+    impl_name = "table";
+    if (want && strcmp(want, "scalar") == 0)
+        return;
+#ifdef MORTON_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("bmi2")) {
+        morton_encode = encode_bmi2;
+        morton_decode = decode_bmi2;
+        impl_name = "bmi2";
+    }
+#endif
+}
+
+const char *morton_impl_name() { return impl_name; }
+
+void morton_axis_table(uint32_t *table, int n, int axis) {
+    for (int i = 0; i < n; i++)
+        table[i] = morton_encode(axis == 0 ? i : 0, axis == 1 ? i : 0,
+                                 axis == 2 ? i : 0);
+}
@@ -0,0 +1,38 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stdint.h>
+
+// 3D Morton (Z-order) codes: the bits of x, y and z interleaved as
+// ...z1 y1 x1 z0 y0 x0, up to MORTON_BITS bits per axis. Cells that are close
+// in 3D get close codes, so storage indexed by code keeps a neighbourhood in
+// a few cache lines instead of spreading it over row-major z strides.
+//
+// morton_encode()/morton_decode() use BMI2 pdep/pext where the cpu has them
+// and byte tables otherwise (or with CUBE_KERNEL=scalar). Hot loops should
+// precompute a per-axis table with morton_axis_table() instead: a code is
+// then just table_x[x] | table_y[y] | table_z[z].
+
+#define MORTON_BITS 10
+
+// picks the implementation, safe to call more than once
+void morton_init();
+const char *morton_impl_name();
+
+extern uint32_t (*morton_encode)(uint32_t x, uint32_t y, uint32_t z);
+extern void (*morton_decode)(uint32_t code, uint32_t *x, uint32_t *y,
+                             uint32_t *z);
+
+// table[i] = code of i on `axis` (0 = x, 1 = y, 2 = z) for i in [0, n)
+void morton_axis_table(uint32_t *table, int n, int axis);
+
+// smallest power of two >= n, the side of the cube of codes [0, side^3)
+// that covers an n-wide axis
+static inline int morton_side(int n) {
+    int side = 1;
+    while (side < n)
+        side *= 2;
+    return side;
+}
+
+#endif // MORTON_H
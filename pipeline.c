@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+//
+#include "pipeline.h"
+
+static void *producer(void *arg) {
+    SimPipeline *pipe = arg;
+    prof_bind(pipe->prof);
+    for (;;) {
+        sem_wait(&pipe->wake);
+        if (atomic_load_explicit(&pipe->quit, memory_order_acquire))
+            break;
+        uint64_t now = prof_now();
+        double dt = pipe->last_ns ? (now - pipe->last_ns) / 1e9 : 0.0;
+        pipe->last_ns = now;
+
+        prof_frame_begin();
+        int level = atomic_load_explicit(&pipe->quality, memory_order_relaxed);
+        quality_apply(pipe->sim, level);
+        if (atomic_exchange_explicit(&pipe->skip, 0, memory_order_relaxed))
+            sim_skip(pipe->sim, &pipe->clock, dt);
+        else
+            sim_update(pipe->sim, &pipe->clock, (float)dt);
+        prof_begin(PROF_FIELD);
+        pool_eval(pipe->pool, pipe->sim);
+        prof_end(PROF_FIELD);
+        prof_begin(PROF_EMIT);
+        PipelineFrame *frame = &pipe->frames[pipe->slots.back];
+        instance_batch_clear(&frame->batch);
+        pool_for_each_hit(pipe->pool, instance_batch_push_cube, &frame->batch);
+        prof_end(PROF_EMIT);
+        frame->bullet_count = pipe->sim->bullet_count;
+        frame->visible_count = pipe->sim->visible_count;
+        frame->index = pipe->produced++;
+        prof_frame_end();
+        atomic_store_explicit(&pipe->busy_ns, prof_now() - now,
+                              memory_order_relaxed);
+
+        // publish: the old middle slot becomes the next back slot
+        int prev = atomic_exchange_explicit(
+            &pipe->slots.state, pipe->slots.back | PIPELINE_FRESH,
+            memory_order_acq_rel);
+        pipe->slots.back = prev & ~PIPELINE_FRESH;
+    }
+    prof_bind(NULL);
+    return NULL;
+}
+
+SimPipeline *pipeline_start(Sim *sim, FieldPool *pool) {
+    SimPipeline *pipe = calloc(1, sizeof(SimPipeline));
+    if (!pipe) {
+        fprintf(stderr, "out of memory starting the sim pipeline\n");
+        exit(1);
+    }
+    pipe->sim = sim;
+    pipe->pool = pool;
+    pipe->clock = sim_clock_init(0);
+    pipe->prof = prof_create("sim", 2);
+    for (int i = 0; i < 3; i++) {
+        pipe->frames[i].batch.grid = &sim->grid;
+        instance_batch_reserve(&pipe->frames[i].batch,
+                               INSTANCE_BATCH_MIN_CAP);
+    }
+    // producer writes 0, 1 is in the middle (empty, not fresh), consumer
+    // reads 2
+    pipe->slots.back = 0;
+    atomic_init(&pipe->slots.state, 1);
+    pipe->slots.front = 2;
+    atomic_init(&pipe->quit, 0);
+    atomic_init(&pipe->quality, 0);
+    atomic_init(&pipe->busy_ns, 0);
+    atomic_init(&pipe->skip, 0);
+    // one frame of work up front
+    if (sem_init(&pipe->wake, 0, 1) != 0 ||
+        pthread_create(&pipe->thread, NULL, producer, pipe) != 0) {
+        fprintf(stderr, "failed to start the sim pipeline\n");
+        exit(1);
+    }
+    return pipe;
+}
+
+void pipeline_stop(SimPipeline *pipe) {
+    atomic_store_explicit(&pipe->quit, 1, memory_order_release);
+    sem_post(&pipe->wake);
+    pthread_join(pipe->thread, NULL);
+    sem_destroy(&pipe->wake);
+    for (int i = 0; i < 3; i++)
+        instance_batch_free(&pipe->frames[i].batch);
+    prof_destroy(pipe->prof);
+    free(pipe);
+}
+
+void pipeline_set_quality(SimPipeline *pipe, int level) {
+    atomic_store_explicit(&pipe->quality, level, memory_order_relaxed);
+}
+
+void pipeline_skip_next(SimPipeline *pipe) {
+    atomic_store_explicit(&pipe->skip, 1, memory_order_relaxed);
+}
+
+const PipelineFrame *pipeline_acquire(SimPipeline *pipe) {
+    TripleBuffer *tb = &pipe->slots;
+    if (atomic_load_explicit(&tb->state, memory_order_relaxed) &
+        PIPELINE_FRESH) {
+        int prev = atomic_exchange_explicit(&tb->state, tb->front,
+                                            memory_order_acq_rel);
+        tb->front = prev & ~PIPELINE_FRESH;
+        // the producer can start on the next frame while this one's drawn
+        sem_post(&pipe->wake);
+    }
+    return &pipe->frames[tb->front];
+}
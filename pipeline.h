@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+//
+#include "governor.h"
+#include "linebatch.h"
+#include "pool.h"
+#include "profiler.h"
+#include "sim.h"
+
+// Pipelined CPU frames: a producer thread runs the sim, evaluates the field
+// and emits the lit cubes of frame N+1 while the main thread uploads and
+// draws frame N.
+//
+// Finished frames are handed over through a triple buffer: the producer
+// fills its back slot and swaps it with the middle one, the consumer swaps
+// its front slot with the middle one whenever a fresh frame is waiting.
+// Both swaps are a single atomic exchange, so the main thread never waits
+// on the producer: without a fresh frame it just gets the last one again.
+//
+// Once the main thread takes a frame it wakes the producer for the next
+// one, so the producer stays one frame ahead instead of spinning. The
+// producer measures its own frame time and feeds it to a SimClock, and
+// everything it times goes to its own profiler ("sim").
+//
+// The sim belongs to the producer, so quality levels picked by the governor
+// on the main thread are handed over through `quality` and applied before
+// the next frame, and the producer publishes how long its last frame took
+// for the governor to count. Frames after an idle or paused stretch are
+// flagged the same way, so the producer catches up on them with sim_skip()
+// rather than ticking through at most MAX_CATCHUP_TICKS.
+
+#define PIPELINE_FRESH 4 // in TripleBuffer.state, next to the middle index
+
+typedef struct TripleBuffer {
+    atomic_int state; // middle slot | PIPELINE_FRESH if it's unread
+    int back;         // producer's
+    int front;        // consumer's
+} TripleBuffer;
+
+typedef struct PipelineFrame {
+    InstanceBatch batch;
+    int bullet_count;
+    int visible_count; // Sim.visible_count
+    uint64_t index; // frames produced before this one
+} PipelineFrame;
+
+typedef struct SimPipeline {
+    Sim *sim;
+    FieldPool *pool;
+    SimClock clock;
+    Profiler *prof;
+    pthread_t thread;
+    sem_t wake;
+    atomic_int quit;
+    atomic_int quality;       // level for the next frame, see governor.h
+    _Atomic uint64_t busy_ns; // producer time of the last frame
+    atomic_int skip;          // the next frame catches up with sim_skip()
+    uint64_t produced;
+    uint64_t last_ns;
+    TripleBuffer slots;
+    PipelineFrame frames[3];
+} SimPipeline;
+
+// starts producing into `sim` with `pool`, both owned by the producer until
+// pipeline_stop()
+SimPipeline *pipeline_start(Sim *sim, FieldPool *pool);
+// joins the producer and frees the frames, `sim` and `pool` are the
+// caller's again
+void pipeline_stop(SimPipeline *pipe);
+
+// frames produced from now on use quality level `level`
+void pipeline_set_quality(SimPipeline *pipe, int level);
+
+// the producer's next frame catches up on everything since its last one
+// with sim_skip(), call it before the pipeline_acquire() that wakes it
+void pipeline_skip_next(SimPipeline *pipe);
+
+// the newest finished frame, valid until the next call. before the first
+// one is done that's an empty frame
+const PipelineFrame *pipeline_acquire(SimPipeline *pipe);
+
+#endif // PIPELINE_H
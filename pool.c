@@ -0,0 +1,291 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+//
+#include "pool.h"
+#include "sim.h"
+
+#define MAX_THREADS 64
+
+// one per worker, padded so neighbouring workers don't share a cache line
+typedef struct Worker {
+    _Alignas(64) atomic_int next_slab; // claimed by owner *and* thieves
+    int end_slab;
+    long evaluated;
+    FieldPool *pool;
+    int id;
+    pthread_t thread;
+} Worker;
+
+struct FieldPool {
+    Worker workers[MAX_THREADS];
+    int thread_count;
+
+    // per-frame read-only input, built by pool_eval() before waking workers
+    const Sim *sim;
+    BulletBox *boxes; // parallel to sim->bullets.live
+    int boxes_cap;
+
+    // the field. pool_eval() activates every brick a box touches up front,
+    // the workers only ever fill pages
+    BrickMap bricks;
+    BrickOrder order;
+    BlendMode blend;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond, done_cond;
+    unsigned generation;
+    int running;
+    int quit;
+};
+
+// ----------- ~%~ worker ~%~ -----------
+
+// resolves one bullet's contribution into the field. only the worker that
+// owns the cell's slab ever gets here for that cell, and slabs are whole
+// BRICK_WORD_Z runs of z-layers, so that worker also owns the mask word
+static void write_cell(void *user, int cube_idx, Vector3 cube_pos,
+                       float side_len, Vector4 color) {
+    (void)cube_pos;
+    Worker *w = user;
+    const Grid *grid = &w->pool->sim->grid;
+    const BrickMap *map = &w->pool->bricks;
+    unsigned layer = (unsigned)(grid->nx * grid->ny);
+    unsigned z = (unsigned)cube_idx / layer;
+    unsigned rest = (unsigned)cube_idx - z * layer;
+    unsigned y = rest / (unsigned)grid->nx, x = rest - y * (unsigned)grid->nx;
+    BrickPage *page = brick_page(map, brick_of(map, x, y, z));
+    int c = brick_cell(map, x, y, z);
+    uint64_t bit = 1ull << (c & 63);
+    if (!(page->mask[c >> 6] & bit)) {
+        page->mask[c >> 6] |= bit;
+        page->side_len[c] = 0.0f;
+        page->color[c] = (Vector4){0};
+    }
+
+    switch (w->pool->blend) {
+    case BLEND_MAX:
+        if (side_len > page->side_len[c]) {
+            page->side_len[c] = side_len;
+            page->color[c] = color;
+        }
+        break;
+    case BLEND_ADD: {
+        Vector4 *acc = &page->color[c];
+        page->side_len[c] += side_len;
+        *acc = (Vector4){acc->x + color.x * side_len,
+                         acc->y + color.y * side_len,
+                         acc->z + color.z * side_len,
+                         acc->w + color.w * side_len};
+        break;
+    }
+    }
+}
+
+static void eval_slab(Worker *w, int slab) {
+    FieldPool *pool = w->pool;
+    int z0 = slab * SLAB_Z;
+    int nz = pool->sim->grid.nz;
+    int z1 = z0 + SLAB_Z < nz ? z0 + SLAB_Z : nz;
+    const Bullets *bullets = &pool->sim->bullets;
+    for (int i = 0; i < bullets->live_count; i++) {
+        BulletBox bbox = pool->boxes[i];
+        if (bbox.max_z <= z0 || bbox.min_z >= z1)
+            continue;
+        bbox.min_z = bbox.min_z > z0 ? bbox.min_z : z0;
+        bbox.max_z = bbox.max_z < z1 ? bbox.max_z : z1;
+        w->evaluated += sim_eval_bullet_box(pool->sim, bullets->live[i], bbox,
+                                            write_cell, w);
+    }
+}
+
+// drain our own run of slabs first, then steal from everyone else. claiming
+// is a fetch_add on the owner's counter, so owner and thieves never collide
+static void run_worker(Worker *w) {
+    FieldPool *pool = w->pool;
+    w->evaluated = 0;
+    for (int k = 0; k < pool->thread_count; k++) {
+        Worker *victim = &pool->workers[(w->id + k) % pool->thread_count];
+        int slab;
+        while ((slab = atomic_fetch_add_explicit(&victim->next_slab, 1,
+                                                 memory_order_relaxed)) <
+               victim->end_slab)
+            eval_slab(w, slab);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    FieldPool *pool = w->pool;
+    unsigned seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit)
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+            pthread_cond_signal(&pool->done_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// ----------- ~%~ pool ~%~ -----------
+
+FieldPool *pool_create(int threads) {
+    if (threads <= 0) {
+        const char *env = getenv("CUBE_THREADS");
+        threads = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    const char *blend = getenv("CUBE_BLEND");
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+
+    FieldPool *pool = calloc(1, sizeof(FieldPool));
+    if (!pool) {
+        fprintf(stderr, "out of memory creating field pool\n");
+        exit(1);
+    }
+    pool->thread_count = threads;
+    pool->blend = blend && strcmp(blend, "add") == 0 ? BLEND_ADD : BLEND_MAX;
+    pool->order = brick_order_from_env();
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    for (int i = 0; i < threads; i++) {
+        Worker *w = &pool->workers[i];
+        w->pool = pool;
+        w->id = i;
+        // worker 0 is whoever calls pool_eval()
+        if (i > 0)
+            pthread_create(&w->thread, NULL, worker_main, w);
+    }
+    return pool;
+}
+
+void pool_destroy(FieldPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++) {
+        if (i > 0)
+            pthread_join(pool->workers[i].thread, NULL);
+    }
+    free(pool->boxes);
+    brick_map_free(&pool->bricks);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int pool_thread_count(const FieldPool *pool) { return pool->thread_count; }
+
+void pool_set_blend(FieldPool *pool, BlendMode blend) { pool->blend = blend; }
+
+long pool_eval(FieldPool *pool, const Sim *sim) {
+    BrickMap *map = &pool->bricks;
+    int bx = (sim->grid.nx + BRICK_SIZE - 1) / BRICK_SIZE,
+        by = (sim->grid.ny + BRICK_SIZE - 1) / BRICK_SIZE,
+        bz = (sim->grid.nz + BRICK_SIZE - 1) / BRICK_SIZE;
+    if (map->bx != bx || map->by != by || map->bz != bz) {
+        brick_map_free(map);
+        brick_map_init(map, &sim->grid, pool->order);
+    }
+    // drop last frame's cells, only the active bricks are touched
+    brick_map_clear(map);
+
+    pool->sim = sim;
+    const Bullets *bullets = &sim->bullets;
+    if (bullets->cap > pool->boxes_cap) {
+        free(pool->boxes);
+        pool->boxes = malloc(bullets->cap * sizeof(BulletBox));
+        if (!pool->boxes) {
+            fprintf(stderr, "out of memory allocating bullet boxes\n");
+            exit(1);
+        }
+        pool->boxes_cap = bullets->cap;
+    }
+    // bullets outside the grid get an empty box
+    for (int k = 0; k < bullets->live_count; k++) {
+        int i = bullets->live[k];
+        pool->boxes[k] = is_in_grid(bullets, i)
+                             ? get_bullet_bounding_box(
+                                   &sim->grid, bullet_cached_pos(bullets, i),
+                                   bullet_scale(bullets, i))
+                             : (BulletBox){0};
+        brick_map_mark_box(map, pool->boxes[k]);
+    }
+    brick_map_commit(map);
+
+    // hand every worker an equal, contiguous run of slabs
+    int n = pool->thread_count;
+    int slabs = SLAB_COUNT(&sim->grid);
+    for (int i = 0; i < n; i++) {
+        Worker *w = &pool->workers[i];
+        atomic_store_explicit(&w->next_slab, slabs * i / n,
+                              memory_order_relaxed);
+        w->end_slab = slabs * (i + 1) / n;
+    }
+
+    if (n > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->running = n - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    run_worker(&pool->workers[0]);
+    if (n > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->running > 0)
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    long evaluated = 0;
+    for (int i = 0; i < n; i++)
+        evaluated += pool->workers[i].evaluated;
+    return evaluated;
+}
+
+int pool_hit_count(const FieldPool *pool) {
+    return brick_map_count(&pool->bricks);
+}
+
+typedef struct AddResolve {
+    CubeEmitFn emit;
+    void *user;
+} AddResolve;
+
+// BLEND_ADD cells hold size-weighted color sums and unclamped sizes
+static void resolve_add(void *user, int cube_idx, Vector3 cube_pos,
+                        float side_len, Vector4 color) {
+    AddResolve *r = user;
+    float inv = 1.0f / side_len;
+    color = (Vector4){color.x * inv, color.y * inv, color.z * inv,
+                      color.w * inv};
+    side_len = side_len < CUBE_SIZE ? side_len : CUBE_SIZE;
+    r->emit(r->user, cube_idx, cube_pos, side_len, color);
+}
+
+void pool_for_each_hit(const FieldPool *pool, CubeEmitFn emit, void *user) {
+    const Grid *grid = &pool->sim->grid;
+    if (pool->blend == BLEND_ADD) {
+        AddResolve r = {emit, user};
+        brick_map_for_each(&pool->bricks, grid, resolve_add, &r);
+    } else {
+        brick_map_for_each(&pool->bricks, grid, emit, user);
+    }
+}
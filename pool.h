@@ -0,0 +1,50 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "brickmap.h"
+#include "sim.h"
+
+// Multithreaded field evaluation.
+//
+// The grid is cut into slabs of SLAB_Z z-layers. Each worker starts with a
+// contiguous run of slabs and steals from the others once its own run is
+// exhausted (bullets bunch up, so slab costs vary a lot).
+//
+// Every bullet resolves into one per-cube field, so a cube touched by several
+// bullets is still emitted once (like cubegrid.vs). The field is a BrickMap:
+// only bricks some bullet's bounding box reaches get a page, so memory and
+// the final walk follow the active cells rather than the grid volume. A slab
+// is only ever evaluated by one worker and slabs line up with the pages' mask
+// words, so the workers write disjoint cells and words and need no locking.
+// The map is in Morton order, CUBE_ORDER=linear makes it row-major for
+// comparison.
+
+#define SLAB_Z BRICK_WORD_Z
+#define SLAB_COUNT(grid) (((grid)->nz + SLAB_Z - 1) / SLAB_Z)
+
+// how overlapping bullets combine in a cube
+typedef enum BlendMode {
+    BLEND_MAX, // biggest cube wins, takes that bullet's color (shader path)
+    BLEND_ADD, // sizes add up (clamped to CUBE_SIZE), colors size-weighted
+} BlendMode;
+
+typedef struct FieldPool FieldPool;
+
+// threads <= 0 picks CUBE_THREADS from the environment, or one per cpu.
+// blending defaults to BLEND_MAX, CUBE_BLEND=add switches it
+FieldPool *pool_create(int threads);
+void pool_destroy(FieldPool *pool);
+int pool_thread_count(const FieldPool *pool);
+void pool_set_blend(FieldPool *pool, BlendMode blend);
+
+// evaluates every live bullet into the field, the calling thread takes part
+// as worker 0. returns the number of cubes evaluated
+long pool_eval(FieldPool *pool, const Sim *sim);
+
+// lit cubes in the field after the last pool_eval()
+int pool_hit_count(const FieldPool *pool);
+
+// emits every lit cube of the last pool_eval() exactly once, brick by brick
+void pool_for_each_hit(const FieldPool *pool, CubeEmitFn emit, void *user);
+
+#endif // POOL_H
@@ -0,0 +1,309 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+//
+#include "profiler.h"
+
+static _Thread_local Profiler *bound;
+
+static const char *PHASE_NAMES[PROF_PHASE_COUNT] = {
+    [PROF_SPAWN] = "spawn",   [PROF_INTEGRATE] = "integrate",
+    [PROF_FIELD] = "field",   [PROF_EMIT] = "emit",
+    [PROF_UPLOAD] = "upload", [PROF_DRAW] = "draw",
+    [PROF_PRESENT] = "present",
+};
+
+static const char *GPU_PASS_NAMES[PROF_GPU_COUNT] = {
+    [PROF_GPU_FIELD] = "gpu field",
+    [PROF_GPU_CUBES] = "gpu cubes",
+    [PROF_GPU_HUD] = "gpu hud",
+};
+
+// GPU pass tracks get their profiler's tid plus this
+#define GPU_TID_OFFSET 100
+
+const char *prof_phase_name(ProfPhase phase) { return PHASE_NAMES[phase]; }
+const char *prof_gpu_pass_name(ProfGpuPass pass) {
+    return GPU_PASS_NAMES[pass];
+}
+
+uint64_t prof_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t prof_cpu_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+Profiler *prof_create(const char *name, int tid) {
+    Profiler *prof = calloc(1, sizeof(Profiler));
+    if (!prof) {
+        fprintf(stderr, "out of memory allocating profiler\n");
+        exit(1);
+    }
+    prof->name = name;
+    prof->tid = tid;
+    return prof;
+}
+
+void prof_destroy(Profiler *prof) {
+    if (bound == prof)
+        bound = NULL;
+    free(prof);
+}
+
+void prof_bind(Profiler *prof) { bound = prof; }
+Profiler *prof_bound() { return bound; }
+
+// ----------- ~%~ writer ~%~ -----------
+
+static inline uint32_t clamp_ns(uint64_t ns) {
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static void close_top(Profiler *p, uint64_t now) {
+    int d = --p->depth;
+    uint64_t dur = now - p->stack[d].begin;
+    ProfPhase phase = p->stack[d].phase;
+    p->cur.self[phase] += clamp_ns(dur - p->stack[d].children);
+    if (d > 0)
+        p->stack[d - 1].children += dur;
+    if (p->cur.span_count < PROF_MAX_SPANS)
+        p->cur.spans[p->cur.span_count++] = (ProfSpan){
+            .begin = clamp_ns(p->stack[d].begin - p->cur.start),
+            .dur = clamp_ns(dur),
+            .phase = (uint8_t)phase,
+        };
+}
+
+void prof_frame_begin() {
+    Profiler *p = bound;
+    if (!p)
+        return;
+    uint64_t index = atomic_load_explicit(&p->head, memory_order_relaxed);
+    memset(&p->cur, 0, offsetof(ProfFrame, spans));
+    p->cur.index = index;
+    p->cur.start = prof_now();
+    p->depth = 0;
+    p->open = 1;
+}
+
+void prof_frame_end() {
+    Profiler *p = bound;
+    if (!p || !p->open)
+        return;
+    uint64_t now = prof_now();
+    while (p->depth > 0)
+        close_top(p, now);
+    p->cur.dur = clamp_ns(now - p->cur.start);
+    p->open = 0;
+
+    // seqlock publish: readers that see seq change under them drop the copy
+    uint64_t index = p->cur.index;
+    ProfSlot *slot = &p->ring[index & (PROF_FRAMES - 1)];
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->frame, &p->cur,
+           offsetof(ProfFrame, spans) + p->cur.span_count * sizeof(ProfSpan));
+    atomic_store_explicit(&slot->seq, index + 1, memory_order_release);
+    atomic_store_explicit(&p->head, index + 1, memory_order_release);
+}
+
+void prof_begin(ProfPhase phase) {
+    Profiler *p = bound;
+    if (!p || !p->open || p->depth == PROF_MAX_DEPTH)
+        return;
+    p->stack[p->depth].begin = prof_now();
+    p->stack[p->depth].children = 0;
+    p->stack[p->depth].phase = (uint8_t)phase;
+    p->depth++;
+}
+
+// closes `phase` and anything left open inside it
+void prof_end(ProfPhase phase) {
+    Profiler *p = bound;
+    if (!p || !p->open)
+        return;
+    for (int d = p->depth - 1; d >= 0; d--) {
+        if (p->stack[d].phase != phase)
+            continue;
+        uint64_t now = prof_now();
+        while (p->depth > d)
+            close_top(p, now);
+        return;
+    }
+}
+
+uint64_t prof_frame_index() {
+    Profiler *p = bound;
+    return p && p->open ? p->cur.index : 0;
+}
+
+void prof_gpu(ProfGpuPass pass, uint64_t frame, uint32_t ns) {
+    Profiler *p = bound;
+    if (!p || !p->open)
+        return;
+    p->cur.gpu[pass] += ns;
+    p->cur.gpu_mask |= 1u << pass;
+    p->cur.gpu_frame = frame;
+}
+
+// ----------- ~%~ readers ~%~ -----------
+
+int prof_snapshot(Profiler *prof, ProfFrame *out, int max) {
+    uint64_t head = atomic_load_explicit(&prof->head, memory_order_acquire);
+    uint64_t n = head < PROF_FRAMES ? head : PROF_FRAMES;
+    if (n > (uint64_t)max)
+        n = (uint64_t)max;
+    int count = 0;
+    for (uint64_t i = head - n; i < head; i++) {
+        ProfSlot *slot = &prof->ring[i & (PROF_FRAMES - 1)];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != i + 1)
+            continue; // being rewritten, or already lapped
+        memcpy(&out[count], &slot->frame, sizeof(ProfFrame));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)
+            continue;
+        count++;
+    }
+    return count;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank
+static uint32_t percentile(const uint32_t *sorted, int n, int pct) {
+    int rank = (n * pct + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void prof_stats(Profiler *prof, int window, ProfStats *stats) {
+    *stats = (ProfStats){0};
+    if (window > PROF_FRAMES)
+        window = PROF_FRAMES;
+    ProfFrame *frames = malloc((size_t)window * sizeof(ProfFrame));
+    uint32_t *vals = malloc((size_t)window * sizeof(uint32_t));
+    if (!frames || !vals) {
+        fprintf(stderr, "out of memory computing profiler stats\n");
+        exit(1);
+    }
+    int n = prof_snapshot(prof, frames, window);
+    stats->frames = n;
+    if (n > 0) {
+        for (int ph = 0; ph < PROF_PHASE_COUNT; ph++) {
+            for (int i = 0; i < n; i++)
+                vals[i] = frames[i].self[ph];
+            qsort(vals, n, sizeof(uint32_t), cmp_u32);
+            stats->p50[ph] = percentile(vals, n, 50);
+            stats->p99[ph] = percentile(vals, n, 99);
+        }
+        for (int i = 0; i < n; i++)
+            vals[i] = frames[i].dur;
+        qsort(vals, n, sizeof(uint32_t), cmp_u32);
+        stats->frame_p50 = percentile(vals, n, 50);
+        stats->frame_p99 = percentile(vals, n, 99);
+    }
+    for (int pass = 0; pass < PROF_GPU_COUNT; pass++) {
+        int m = 0;
+        for (int i = 0; i < n; i++)
+            if (frames[i].gpu_mask >> pass & 1)
+                vals[m++] = frames[i].gpu[pass];
+        stats->gpu_frames[pass] = m;
+        if (m == 0)
+            continue;
+        qsort(vals, m, sizeof(uint32_t), cmp_u32);
+        stats->gpu_p50[pass] = percentile(vals, m, 50);
+        stats->gpu_p99[pass] = percentile(vals, m, 99);
+    }
+    free(vals);
+    free(frames);
+}
+
+// one complete ("X") event, times in µs from `base`
+static void write_event(FILE *f, int *first, const char *name, int tid,
+                        uint64_t start, uint64_t dur, uint64_t base) {
+    fprintf(f,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            *first ? "" : ",", name, tid, (double)(start - base) / 1e3,
+            (double)dur / 1e3);
+    *first = 0;
+}
+
+int prof_write_trace(Profiler **profs, int count, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    ProfFrame **frames = calloc(count, sizeof(ProfFrame *));
+    int *counts = calloc(count, sizeof(int));
+    if (!frames || !counts) {
+        fprintf(stderr, "out of memory writing trace\n");
+        exit(1);
+    }
+    // timestamps start at the oldest frame of any ring
+    uint64_t base = UINT64_MAX;
+    for (int t = 0; t < count; t++) {
+        frames[t] = malloc(PROF_FRAMES * sizeof(ProfFrame));
+        if (!frames[t]) {
+            fprintf(stderr, "out of memory writing trace\n");
+            exit(1);
+        }
+        counts[t] = prof_snapshot(profs[t], frames[t], PROF_FRAMES);
+        if (counts[t] > 0 && frames[t][0].start < base)
+            base = frames[t][0].start;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    int first = 1;
+    for (int t = 0; t < count; t++) {
+        Profiler *prof = profs[t];
+        int gpu_tid = prof->tid + GPU_TID_OFFSET;
+        fprintf(f,
+                "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s\"}},"
+                "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s gpu\"}}",
+                first ? "" : ",", prof->tid, prof->name, gpu_tid, prof->name);
+        first = 0;
+        for (int i = 0; i < counts[t]; i++) {
+            const ProfFrame *fr = &frames[t][i];
+            write_event(f, &first, "frame", prof->tid, fr->start, fr->dur,
+                        base);
+            for (int s = 0; s < fr->span_count; s++) {
+                const ProfSpan *sp = &fr->spans[s];
+                write_event(f, &first, PHASE_NAMES[sp->phase], prof->tid,
+                            fr->start + sp->begin, sp->dur, base);
+            }
+            // the issuing frame, if it's still in the snapshot
+            int src = i - (int)(fr->index - fr->gpu_frame);
+            if (!fr->gpu_mask || src < 0 ||
+                frames[t][src].index != fr->gpu_frame)
+                continue;
+            uint64_t at = frames[t][src].start;
+            for (int pass = 0; pass < PROF_GPU_COUNT; pass++) {
+                if (!(fr->gpu_mask >> pass & 1))
+                    continue;
+                write_event(f, &first, GPU_PASS_NAMES[pass], gpu_tid, at,
+                            fr->gpu[pass], base);
+                at += fr->gpu[pass];
+            }
+        }
+        free(frames[t]);
+    }
+    fprintf(f, "\n]}\n");
+    free(counts);
+    free(frames);
+    int err = ferror(f);
+    return fclose(f) != 0 || err ? -1 : 0;
+}
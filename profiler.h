@@ -0,0 +1,137 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Frame-phase profiler.
+//
+// Every frame is a list of timed spans (CLOCK_MONOTONIC, in ns), one per
+// prof_begin()/prof_end() pair. Spans nest: a phase begun while another is
+// open is charged to itself only, so the per-phase totals of a frame are
+// self times and add up to at most the frame time. A phase entered several
+// times in a frame (several sim steps, several draws) adds up.
+//
+// Finished frames go into a ring of the last PROF_FRAMES frames. The thread
+// that times the frames is the only writer and never waits; readers (the
+// HUD, a trace dump, another thread) copy slots out under a per-slot
+// sequence number and skip any slot that was rewritten while they read it.
+//
+// The timing calls go to the profiler bound to the calling thread with
+// prof_bind() and do nothing if none is, so library code (sim_step(),
+// gpu_field_eval()) can be instrumented unconditionally.
+
+#define PROF_FRAMES 4096 // power of two
+#define PROF_MAX_SPANS 48 // per frame, later ones still count towards totals
+#define PROF_MAX_DEPTH 8
+
+typedef enum ProfPhase {
+    PROF_SPAWN,
+    PROF_INTEGRATE,
+    PROF_FIELD,   // field evaluation, or binning for the GPU paths
+    PROF_EMIT,    // vertex / instance emission
+    PROF_UPLOAD,  // buffer, texture and uniform uploads
+    PROF_DRAW,    // draw submission
+    PROF_PRESENT, // swap and frame pacing
+    PROF_PHASE_COUNT,
+} ProfPhase;
+
+// GPU passes, timed by GpuTimer (gputimer.h). their durations come in a few
+// frames late and are filed under the frame they arrive in, `gpu_frame`
+// names the frame that issued them
+typedef enum ProfGpuPass {
+    PROF_GPU_FIELD, // compute field: uploads and dispatch
+    PROF_GPU_CUBES, // the cube draw, field evaluation too with cubegrid.vs
+    PROF_GPU_HUD,
+    PROF_GPU_COUNT,
+} ProfGpuPass;
+
+typedef struct ProfSpan {
+    uint32_t begin, dur; // ns, begin relative to the frame start
+    uint8_t phase;
+} ProfSpan;
+
+typedef struct ProfFrame {
+    uint64_t index;
+    uint64_t start;                  // ns, CLOCK_MONOTONIC
+    uint32_t dur;                    // ns, frame start to frame end
+    uint32_t self[PROF_PHASE_COUNT]; // ns, self time per phase
+    uint32_t gpu[PROF_GPU_COUNT];    // ns, valid where gpu_mask has the bit
+    uint32_t gpu_mask;
+    uint64_t gpu_frame;
+    int span_count;
+    ProfSpan spans[PROF_MAX_SPANS];
+} ProfFrame;
+
+typedef struct ProfSlot {
+    _Atomic uint64_t seq; // index + 1 once published, 0 while written
+    ProfFrame frame;
+} ProfSlot;
+
+typedef struct Profiler {
+    const char *name; // thread name in traces
+    int tid;
+    _Atomic uint64_t head; // frames published so far
+    // the frame being timed, owned by the writer
+    ProfFrame cur;
+    int open;
+    int depth;
+    struct {
+        uint64_t begin, children;
+        uint8_t phase;
+    } stack[PROF_MAX_DEPTH];
+    ProfSlot ring[PROF_FRAMES];
+} Profiler;
+
+// p50/p99 of the self time of every phase and of the whole frame, in ns
+typedef struct ProfStats {
+    int frames;
+    uint32_t p50[PROF_PHASE_COUNT], p99[PROF_PHASE_COUNT];
+    uint32_t frame_p50, frame_p99;
+    // over the frames that got a result for the pass, 0 if none did
+    int gpu_frames[PROF_GPU_COUNT];
+    uint32_t gpu_p50[PROF_GPU_COUNT], gpu_p99[PROF_GPU_COUNT];
+} ProfStats;
+
+// the ring is big, allocate it. `name` and `tid` label it in traces
+Profiler *prof_create(const char *name, int tid);
+void prof_destroy(Profiler *prof);
+
+// timing calls on this thread go to `prof` from now on, NULL stops them
+void prof_bind(Profiler *prof);
+Profiler *prof_bound();
+
+uint64_t prof_now();
+// ns of CPU time the whole process has used, every thread
+uint64_t prof_cpu_now();
+
+// frames run from prof_frame_begin() to prof_frame_end(), which publishes
+// them. spans still open at the end are closed there
+void prof_frame_begin();
+void prof_frame_end();
+void prof_begin(ProfPhase phase);
+void prof_end(ProfPhase phase);
+
+// index of the frame being timed, 0 outside one
+uint64_t prof_frame_index();
+// files a GPU pass duration that frame `frame` issued into the current one
+void prof_gpu(ProfGpuPass pass, uint64_t frame, uint32_t ns);
+
+const char *prof_phase_name(ProfPhase phase);
+const char *prof_gpu_pass_name(ProfGpuPass pass);
+
+// copies the newest (up to) `max` published frames into `out`, oldest
+// first. safe from any thread. returns how many were copied
+int prof_snapshot(Profiler *prof, ProfFrame *out, int max);
+
+// percentiles over the newest `window` frames
+void prof_stats(Profiler *prof, int window, ProfStats *stats);
+
+// writes every frame still in the rings as Chrome trace event JSON
+// (chrome://tracing, Perfetto), one track per profiler plus one for its GPU
+// passes. GPU passes only have durations, they're laid out back to back from
+// the start of the frame that issued them. returns 0 on success
+int prof_write_trace(Profiler **profs, int count, const char *path);
+
+#endif // PROFILER_H
@@ -0,0 +1,695 @@
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+//
+#include "field.h"
+#include "profiler.h"
+#include "sim.h"
+#include "spawntrace.h"
+
+// bullet constants, in multiples of the grid's x length
+static const float MIN_SPEED = 1.0f / 5.0f;
+static const float MAX_SPEED = MIN_SPEED * 2.0f;
+
+// how many
+static const float MIN_BULLET_RADIUS = 1.0f / 15.0f;
+static const float MAX_BULLET_RADIUS = MIN_BULLET_RADIUS * 2.0f;
+
+static const float MIN_BULLET_LEN = 1.0f / 5.0f;
+static const float MAX_BULLET_LEN = MIN_BULLET_LEN * 2.0f;
+
+// ----------- ~%~ helper fn's ~%~ -----------
+
+// todo: feed some unique value to this at runtime?
+#define DEFAULT_SEED 12345
+#define XOR_MAGIC 0x2545F4914F6CDD1D
+static uint32_t xorshift_state = DEFAULT_SEED;
+
+// xorshift32
+uint32_t next_rand() {
+    uint32_t x = xorshift_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    xorshift_state = x;
+    return x;
+}
+
+float next_randf(float min, float max) {
+    return min + (max - min) * (float)next_rand() / (float)UINT32_MAX;
+}
+
+static inline Vector4 lerp4(Vector4 a, Vector4 b, float t) {
+    return (Vector4){a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+                     a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+}
+
+// todo: refactor so we include the scale offset here, will probably look nicer
+static inline float get_start_pos(const Grid *grid, int dir) {
+    switch (dir) {
+    case NX:
+        return grid->max.x;
+    case PX:
+        return grid->min.x;
+    case NY:
+        return grid->max.y;
+    case PY:
+        return grid->min.y;
+    case NZ:
+        return grid->max.z;
+    case PZ:
+        return grid->min.z;
+    default:
+        __builtin_unreachable();
+    }
+}
+
+static inline float get_random_grid_pos(int dim_count, float min_val) {
+    return min_val +
+           (float)(next_rand() % dim_count) * (CUBE_SIZE + CUBE_PADDING);
+}
+
+int is_out_of_bounds(const Grid *grid, Vector3 pos, Vector3 scale, int dir) {
+    switch (dir) {
+    case PX:
+        return pos.x > (grid->max.x + scale.x);
+    case NX:
+        return pos.x < (grid->min.x - scale.x);
+    case PY:
+        return pos.y > (grid->max.y + scale.y);
+    case NY:
+        return pos.y < (grid->min.y - scale.y);
+    case PZ:
+        return pos.z > (grid->max.z + scale.z);
+    case NZ:
+        return pos.z < (grid->min.z - scale.z);
+    }
+    return 1;
+}
+
+static inline int world_to_index(float coord, float base_pos, int max_idx) {
+    // NOTE: idk why ceilf had to be used here but it fixed an off by -1 offset
+    // issue.
+    int ret = (int)ceilf((coord - base_pos) / (CUBE_SIZE + CUBE_PADDING));
+    return ret > max_idx ? max_idx : ret < 0 ? 0 : ret;
+}
+
+BulletBox get_bullet_bounding_box(const Grid *grid, Vector3 pos,
+                                  Vector3 scale) {
+    Vector3 c = grid->min_center;
+    return (BulletBox){
+        .min_x = world_to_index(pos.x - scale.x, c.x, grid->nx),
+        .max_x = world_to_index(pos.x + scale.x, c.x, grid->nx),
+        .min_y = world_to_index(pos.y - scale.y, c.y, grid->ny),
+        .max_y = world_to_index(pos.y + scale.y, c.y, grid->ny),
+        .min_z = world_to_index(pos.z - scale.z, c.z, grid->nz),
+        .max_z = world_to_index(pos.z + scale.z, c.z, grid->nz),
+    };
+}
+
+// ----------- ~%~ grid ~%~ -----------
+
+static inline int clamp_dim(int n) {
+    return n < 1 ? 1 : n > GRID_MAX_DIM ? GRID_MAX_DIM : n;
+}
+
+Grid grid_init(int nx, int ny, int nz) {
+    if (nx <= 0) {
+        nx = ny = nz = DEFAULT_CUBES;
+        const char *env = getenv("CUBE_GRID");
+        if (env) {
+            int n = sscanf(env, "%dx%dx%d", &nx, &ny, &nz);
+            if (n == 1)
+                ny = nz = nx;
+            else if (n != 3)
+                nx = ny = nz = DEFAULT_CUBES;
+        }
+    }
+    Grid grid = {
+        .nx = clamp_dim(nx),
+        .ny = clamp_dim(ny),
+        .nz = clamp_dim(nz),
+        .step = CUBE_SIZE + CUBE_PADDING,
+    };
+    grid.size = (Vector3){GETLENGTH(grid.nx), GETLENGTH(grid.ny),
+                          GETLENGTH(grid.nz)};
+    grid.min = (Vector3){CENTER.x - grid.size.x / 2.0f,
+                         CENTER.y - grid.size.y / 2.0f,
+                         CENTER.z - grid.size.z / 2.0f};
+    grid.max = (Vector3){CENTER.x + grid.size.x / 2.0f,
+                         CENTER.y + grid.size.y / 2.0f,
+                         CENTER.z + grid.size.z / 2.0f};
+    grid.min_center = (Vector3){grid.min.x + CUBE_SIZE / 2.0f,
+                                grid.min.y + CUBE_SIZE / 2.0f,
+                                grid.min.z + CUBE_SIZE / 2.0f};
+    return grid;
+}
+
+// ----------- ~%~ despawn wheel ~%~ -----------
+
+static inline int wheel_slot(double time) {
+    return (int)((uint64_t)(time / DESPAWN_WHEEL_TICK) %
+                 DESPAWN_WHEEL_SLOTS);
+}
+
+static void wheel_insert(TimerWheel *wheel, int idx, double deadline) {
+    int slot = wheel_slot(deadline);
+    int head = wheel->head[slot];
+    wheel->prev[idx] = -1;
+    wheel->next[idx] = head;
+    if (head >= 0)
+        wheel->prev[head] = idx;
+    wheel->head[slot] = idx;
+}
+
+static void wheel_remove(TimerWheel *wheel, int idx, double deadline) {
+    int prev = wheel->prev[idx], next = wheel->next[idx];
+    if (prev >= 0)
+        wheel->next[prev] = next;
+    else
+        wheel->head[wheel_slot(deadline)] = next;
+    if (next >= 0)
+        wheel->prev[next] = prev;
+}
+
+// walks every tick from the cursor up to `time`. a slot also holds deadlines
+// a whole turn (or more) away, those are skipped by comparing the deadline.
+// the current tick stays unexpired, later deadlines in it may still be due
+// next frame
+void expire_bullets(Bullets *bullets, double time) {
+    TimerWheel *wheel = &bullets->despawn;
+    uint64_t now = (uint64_t)(time / DESPAWN_WHEEL_TICK);
+    uint64_t first = wheel->cursor;
+    // after a long stall every slot gets visited once, not once per turn
+    if (now - first >= DESPAWN_WHEEL_SLOTS)
+        first = now - DESPAWN_WHEEL_SLOTS + 1;
+    for (uint64_t tick = first; tick <= now; tick++) {
+        int idx = wheel->head[tick % DESPAWN_WHEEL_SLOTS];
+        while (idx >= 0) {
+            int next = wheel->next[idx];
+            if (bullets->cold.despawn_times[idx] <= time)
+                free_bullet(bullets, idx);
+            idx = next;
+        }
+    }
+    wheel->cursor = now;
+}
+
+// ----------- ~%~ spawn logic ~%~ -----------
+
+// hot arrays in the order they're carved out of the block, spawn_times first
+// since it's the only double array
+#define HOT_FLOAT_ARRAYS 15
+
+void bullets_init(Bullets *bullets, int cap) {
+    int padded = (cap + BULLET_LANES - 1) / BULLET_LANES * BULLET_LANES;
+    *bullets = (Bullets){.cap = cap, .live_limit = cap, .padded = padded};
+    bullets->live = malloc(cap * sizeof(int));
+    bullets->slot_of = malloc(cap * sizeof(int));
+    bullets->spawned = calloc((padded + 63) / 64, sizeof(uint64_t));
+    bullets->in_grid = calloc((padded + 63) / 64, sizeof(uint64_t));
+    // padded * sizeof(float) is a multiple of BULLET_ALIGN, so every array
+    // carved out of the block stays aligned
+    size_t hot_size =
+        (size_t)padded * (sizeof(double) + HOT_FLOAT_ARRAYS * sizeof(float));
+    bullets->hot_block = aligned_alloc(BULLET_ALIGN, hot_size);
+    bullets->cold.despawn_times = malloc(cap * sizeof(double));
+    bullets->cold.colors = malloc(cap * sizeof(Vector4));
+    bullets->cold.speeds = malloc(cap * sizeof(float));
+    bullets->cold.directions = malloc(cap * sizeof(uint8_t));
+    bullets->stamps = calloc(cap, sizeof(BulletStamp));
+    bullets->despawn.next = malloc(cap * sizeof(int));
+    bullets->despawn.prev = malloc(cap * sizeof(int));
+    if (!bullets->live || !bullets->slot_of || !bullets->spawned ||
+        !bullets->in_grid || !bullets->hot_block ||
+        !bullets->cold.despawn_times || !bullets->cold.colors ||
+        !bullets->cold.speeds || !bullets->cold.directions ||
+        !bullets->stamps ||
+        !bullets->despawn.next || !bullets->despawn.prev) {
+        fprintf(stderr, "out of memory allocating %d bullets\n", cap);
+        exit(1);
+    }
+
+    BulletsHot *h = &bullets->hot;
+    h->spawn_times = bullets->hot_block;
+    float *next = (float *)(h->spawn_times + padded);
+    float **arrays[HOT_FLOAT_ARRAYS] = {
+        &h->px, &h->py, &h->pz, &h->x0, &h->y0, &h->z0,
+        &h->vx, &h->vy, &h->vz, &h->sx, &h->sy, &h->sz,
+        &h->inv_sx, &h->inv_sy, &h->inv_sz,
+    };
+    for (int a = 0; a < HOT_FLOAT_ARRAYS; a++, next += padded)
+        *arrays[a] = next;
+    // every slot, padding included, starts out dead (see BulletsHot)
+    for (int i = 0; i < padded; i++) {
+        h->spawn_times[i] = 0.0;
+        h->px[i] = h->py[i] = h->pz[i] = FLT_MAX;
+        h->x0[i] = h->y0[i] = h->z0[i] = FLT_MAX;
+        h->vx[i] = h->vy[i] = h->vz[i] = 0.0f;
+        h->sx[i] = h->sy[i] = h->sz[i] = 1.0f;
+        h->inv_sx[i] = h->inv_sy[i] = h->inv_sz[i] = 1.0f;
+    }
+    for (int i = 0; i < cap; i++) {
+        bullets->live[i] = i;
+        bullets->slot_of[i] = i;
+    }
+    for (int i = 0; i < DESPAWN_WHEEL_SLOTS; i++)
+        bullets->despawn.head[i] = -1;
+}
+
+void bullets_free(Bullets *bullets) {
+    for (int i = 0; i < bullets->cap && bullets->stamps; i++)
+        free(bullets->stamps[i].l1);
+    free(bullets->stamps);
+    free(bullets->live);
+    free(bullets->slot_of);
+    free(bullets->spawned);
+    free(bullets->in_grid);
+    free(bullets->hot_block);
+    free(bullets->cold.despawn_times);
+    free(bullets->cold.colors);
+    free(bullets->cold.speeds);
+    free(bullets->cold.directions);
+    free(bullets->despawn.next);
+    free(bullets->despawn.prev);
+    *bullets = (Bullets){0};
+}
+
+void free_bullet(Bullets *bullets, int idx) {
+    BulletsHot *h = &bullets->hot;
+    wheel_remove(&bullets->despawn, idx, bullets->cold.despawn_times[idx]);
+    // prevent random background stutters
+    h->x0[idx] = h->y0[idx] = h->z0[idx] = FLT_MAX;
+    h->px[idx] = h->py[idx] = h->pz[idx] = FLT_MAX;
+    h->vx[idx] = h->vy[idx] = h->vz[idx] = 0.0f;
+    bullets->spawned[idx >> 6] &= ~(1ull << (idx & 63));
+    bullets->in_grid[idx >> 6] &= ~(1ull << (idx & 63));
+    free(bullets->stamps[idx].l1);
+    bullets->stamps[idx] = (BulletStamp){0};
+    bullets->version++;
+
+    // swap-remove: the last live bullet takes our slot, we take its
+    int slot = bullets->slot_of[idx];
+    int last = --bullets->live_count;
+    int moved = bullets->live[last];
+    bullets->live[slot] = moved;
+    bullets->slot_of[moved] = slot;
+    bullets->live[last] = idx;
+    bullets->slot_of[idx] = last;
+}
+
+int bullets_advance(Bullets *bullets, const Grid *grid, double time) {
+    bullets->time = time;
+    return bullet_advance(&bullets->hot, bullets->padded, time, grid,
+                          bullets->in_grid);
+}
+
+// tabulates the L1 distance over the two axes the bullet doesn't move along,
+// for the cells get_bullet_bounding_box() covers on them. `w` is the motion
+// axis. summed in x/y/z order, like sim_eval_bullet_box() does for a row
+static void build_stamp(const Grid *grid, BulletStamp *stamp, int w,
+                        Vector3 start, Vector3 scale) {
+    int u = w == 0 ? 1 : 0, v = w == 2 ? 1 : 2;
+    float cu = ((float *)&start)[u], cv = ((float *)&start)[v];
+    float su = ((float *)&scale)[u], sv = ((float *)&scale)[v];
+    float mu = ((float *)&grid->min_center)[u];
+    float mv = ((float *)&grid->min_center)[v];
+    BulletBox box = get_bullet_bounding_box(grid, start, scale);
+    const int *range = &box.min_x; // min, max per axis
+    *stamp = (BulletStamp){
+        .u0 = range[2 * u],
+        .v0 = range[2 * v],
+        .nu = range[2 * u + 1] - range[2 * u],
+        .nv = range[2 * v + 1] - range[2 * v],
+    };
+    if (stamp->nu <= 0 || stamp->nv <= 0 ||
+        stamp->nu * stamp->nv > STAMP_MAX_CELLS) {
+        stamp->nu = stamp->nv = 0;
+        return;
+    }
+    stamp->l1 = malloc(stamp->nu * stamp->nv * sizeof(float));
+    if (!stamp->l1) {
+        fprintf(stderr, "out of memory allocating a bullet stamp\n");
+        exit(1);
+    }
+    float inv_su = 1.0f / su, inv_sv = 1.0f / sv;
+    for (int j = 0; j < stamp->nv; j++) {
+        float dv = fabsf((cv - (mv + (float)(stamp->v0 + j) * grid->step)) *
+                         inv_sv);
+        for (int i = 0; i < stamp->nu; i++) {
+            float du =
+                fabsf((cu - (mu + (float)(stamp->u0 + i) * grid->step)) *
+                      inv_su);
+            stamp->l1[j * stamp->nu + i] = du + dv;
+        }
+    }
+}
+
+// draws a spawn from the rng, in the order the original spawn code did
+static SpawnRecord roll_spawn(const Grid *grid, double time) {
+    SpawnRecord rec = {.time = time};
+    rec.color_t = next_randf(0.0f, 1.0f);
+    int dir = 1 << (next_rand() % DIR_LEN);
+    rec.dir = (uint8_t)dir;
+
+    float len = grid->size.x;
+    rec.speed = next_randf(MIN_SPEED * len, MAX_SPEED * len);
+    float bullet_radius =
+        next_randf(MIN_BULLET_RADIUS * len, MAX_BULLET_RADIUS * len);
+    rec.scale[0] = rec.scale[1] = rec.scale[2] = bullet_radius;
+    rec.start[0] = get_random_grid_pos(grid->nx, grid->min_center.x);
+    rec.start[1] = get_random_grid_pos(grid->ny, grid->min_center.y);
+    rec.start[2] = get_random_grid_pos(grid->nz, grid->min_center.z);
+
+    // the motion axis: long along it, and starting just outside the grid
+    int xyz_idx = get_xyz(dir);
+    float sign = get_sign(dir);
+    rec.scale[xyz_idx] =
+        next_randf(MIN_BULLET_LEN * len, MAX_BULLET_LEN * len);
+    rec.start[xyz_idx] = get_start_pos(grid, dir) - rec.scale[xyz_idx] * sign;
+    return rec;
+}
+
+int spawn_bullet_replay(const Grid *grid, Bullets *bullets,
+                        const SpawnRecord *rec) {
+    // get next free bullet, if one is available, bail otherwise
+    if (bullets->live_count >= bullets->live_limit)
+        return -1;
+    int idx = bullets->live[bullets->live_count++];
+    bullets->spawned[idx >> 6] |= 1ull << (idx & 63);
+
+    // initialize bullet data
+
+    BulletsCold *cold = &bullets->cold;
+    cold->colors[idx] =
+        lerp4(BULLET_COLOR_FROM, BULLET_COLOR_TO, rec->color_t);
+    int dir = rec->dir;
+    cold->directions[idx] = (uint8_t)dir;
+    cold->speeds[idx] = rec->speed;
+    Vector3 start = {rec->start[0], rec->start[1], rec->start[2]};
+    Vector3 scale = {rec->scale[0], rec->scale[1], rec->scale[2]};
+    Vector3 velocity = {0};
+
+    // grab x,y,z offset so we can point to the relevant axis across multiple
+    // Vector3's when they're casted to float*
+    int xyz_idx = get_xyz(dir);
+    ((float *)&velocity)[xyz_idx] = get_sign(dir) * rec->speed;
+
+    BulletsHot *h = &bullets->hot;
+    h->spawn_times[idx] = rec->time;
+    h->x0[idx] = start.x;
+    h->y0[idx] = start.y;
+    h->z0[idx] = start.z;
+    h->vx[idx] = velocity.x;
+    h->vy[idx] = velocity.y;
+    h->vz[idx] = velocity.z;
+    h->sx[idx] = scale.x;
+    h->sy[idx] = scale.y;
+    h->sz[idx] = scale.z;
+    h->inv_sx[idx] = 1.0f / scale.x;
+    h->inv_sy[idx] = 1.0f / scale.y;
+    h->inv_sz[idx] = 1.0f / scale.z;
+    build_stamp(grid, &bullets->stamps[idx], xyz_idx, start, scale);
+
+    // it's out of bounds once it has fully left the far side (see
+    // is_out_of_bounds()), a grid length plus both ends of the bullet away
+    float travel =
+        ((float *)&grid->size)[xyz_idx] + 2.0f * rec->scale[xyz_idx];
+    cold->despawn_times[idx] = rec->time + travel / rec->speed;
+    wheel_insert(&bullets->despawn, idx, cold->despawn_times[idx]);
+    bullets->version++;
+    return idx;
+}
+
+int spawn_bullet(const Grid *grid, Bullets *bullets, double time,
+                 SpawnRecord *out) {
+    // a full pool draws nothing from the rng
+    if (bullets->live_count >= bullets->live_limit)
+        return -1;
+    SpawnRecord rec = roll_spawn(grid, time);
+    if (out)
+        *out = rec;
+    return spawn_bullet_replay(grid, bullets, &rec);
+}
+
+// ----------- ~%~ sim ~%~ -----------
+
+void sim_init(Sim *sim, Grid grid, int bullet_cap) {
+    if (bullet_cap <= 0) {
+        const char *env = getenv("CUBE_BULLETS");
+        bullet_cap = env ? atoi(env) : DEFAULT_BULLET_CAP;
+        bullet_cap = bullet_cap > 0 ? bullet_cap : DEFAULT_BULLET_CAP;
+    }
+    const char *spawn_scale = getenv("CUBE_SPAWN_SCALE");
+
+    *sim = (Sim){.grid = grid, .spawn_throttle = 1.0f};
+    xorshift_state = DEFAULT_SEED;
+    field_init();
+    bullets_init(&sim->bullets, bullet_cap);
+    sim->spawn_delay_scale = spawn_scale ? (float)atof(spawn_scale) : 1.0f;
+    if (sim->spawn_delay_scale <= 0.0f)
+        sim->spawn_delay_scale = 1.0f;
+    sim->spawn_timer = next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY) *
+                       sim->spawn_delay_scale;
+
+    const char *replay = getenv("CUBE_REPLAY");
+    const char *record = getenv("CUBE_RECORD");
+    if (replay)
+        sim->replay = spawn_reader_open(replay, &sim->grid);
+    if (record)
+        sim->record = spawn_writer_open(record, &sim->grid, bullet_cap);
+}
+
+void sim_free(Sim *sim) {
+    spawn_reader_close(sim->replay);
+    spawn_writer_close(sim->record);
+    bullets_free(&sim->bullets);
+}
+
+// spawn and despawn bullets and advance the clock. nothing is integrated,
+// positions are a function of time and bullets_advance() caches them
+static void sim_tick(Sim *sim, float dt) {
+    Bullets *bullets = &sim->bullets;
+    // every spawn that comes due within the tick, each at the time it's due:
+    // a bullet spawned `due` into the tick has moved for the rest of it by
+    // the end, so spawns don't bunch up on tick boundaries
+    prof_begin(PROF_SPAWN);
+    if (sim->replay) {
+        const SpawnRecord *rec;
+        while ((rec = spawn_reader_next(sim->replay, sim->time + dt)))
+            spawn_bullet_replay(&sim->grid, bullets, rec);
+    } else {
+        float due = sim->spawn_timer;
+        while (due <= dt) {
+            SpawnRecord rec;
+            int idx = spawn_bullet(&sim->grid, bullets, sim->time + due, &rec);
+            if (idx >= 0 && sim->record)
+                spawn_writer_push(sim->record, &rec);
+            due += next_randf(MIN_SPAWN_DELAY, MAX_SPAWN_DELAY) *
+                   sim->spawn_delay_scale * sim->spawn_throttle;
+        }
+        sim->spawn_timer = due - dt;
+    }
+    prof_end(PROF_SPAWN);
+    prof_begin(PROF_INTEGRATE);
+    sim->time += dt;
+    expire_bullets(bullets, sim->time);
+    prof_end(PROF_INTEGRATE);
+}
+
+void sim_step(Sim *sim, float dt) {
+    sim_tick(sim, dt);
+    prof_begin(PROF_INTEGRATE);
+    sim->visible_count =
+        bullets_advance(&sim->bullets, &sim->grid, sim->time);
+    sim->bullet_count = sim->bullets.live_count;
+    prof_end(PROF_INTEGRATE);
+}
+
+SimClock sim_clock_init(int tick_rate) {
+    if (tick_rate <= 0) {
+        const char *env = getenv("CUBE_TICK_RATE");
+        tick_rate = env ? atoi(env) : DEFAULT_TICK_RATE;
+        tick_rate = tick_rate > 0 ? tick_rate : DEFAULT_TICK_RATE;
+    }
+    // the float sim_tick() advances by, so sim->time stays on tick multiples
+    float tick = 1.0f / (float)tick_rate;
+    return (SimClock){.tick = tick, .max_ticks = MAX_CATCHUP_TICKS};
+}
+
+// runs the ticks due in the accumulator, at most `max_ticks`, and caches
+// the bullets at the interpolated render time
+static int clock_run(Sim *sim, SimClock *clock, int max_ticks) {
+    int ticks = 0;
+    while (clock->accumulator >= clock->tick) {
+        if (ticks == max_ticks) {
+            // over budget: keep the fraction, drop the whole ticks
+            double over = clock->accumulator - fmod(clock->accumulator,
+                                                    clock->tick);
+            clock->dropped += over;
+            clock->accumulator -= over;
+            break;
+        }
+        sim_tick(sim, (float)clock->tick);
+        clock->accumulator -= clock->tick;
+        ticks++;
+    }
+    clock->ticks += ticks;
+    clock->alpha = (float)(clock->accumulator / clock->tick);
+
+    // between the previous tick and this one. bullets that spawned later
+    // than that still sit behind their start, outside the grid
+    prof_begin(PROF_INTEGRATE);
+    clock->render_time = sim->time - clock->tick + clock->accumulator;
+    sim->visible_count =
+        bullets_advance(&sim->bullets, &sim->grid, clock->render_time);
+    sim->bullet_count = sim->bullets.live_count;
+    prof_end(PROF_INTEGRATE);
+    return ticks;
+}
+
+int sim_update(Sim *sim, SimClock *clock, float frame_dt) {
+    clock->accumulator += frame_dt > 0.0f ? frame_dt : 0.0f;
+    return clock_run(sim, clock, clock->max_ticks);
+}
+
+int sim_skip(Sim *sim, SimClock *clock, double seconds) {
+    clock->accumulator += seconds > 0.0 ? seconds : 0.0;
+    double window = SKIP_SPAWN_WINDOW + clock->tick;
+    if (clock->accumulator > window) {
+        // whole ticks, so sim->time stays on the tick grid
+        double jump = clock->accumulator - window;
+        jump -= fmod(jump, clock->tick);
+        sim->time += jump;
+        clock->accumulator -= jump;
+        clock->skipped += jump;
+        if (sim->replay)
+            while (spawn_reader_next(sim->replay, sim->time))
+                ;
+    }
+    return clock_run(sim, clock, INT_MAX);
+}
+
+// cube indices [*lo, *hi) along one axis whose centers are within `radius`
+// of `center`, clipped to [min_idx, max_idx). L1_SLACK keeps float rounding
+// from dropping a cell right on the surface
+#define L1_SLACK 1e-3f
+static inline void l1_span(float center, float radius, float base, int min_idx,
+                           int max_idx, int *lo, int *hi) {
+    const float step = CUBE_SIZE + CUBE_PADDING;
+    radius += L1_SLACK;
+    int a = (int)ceilf((center - radius - base) / step);
+    int b = (int)floorf((center + radius - base) / step) + 1;
+    *lo = a > min_idx ? a : min_idx;
+    *hi = b < max_idx ? b : max_idx;
+}
+
+// evaluates the cubes of `bbox` (the bullet's bounding box, or a clipped part
+// of it) that lie inside the bullet's octahedron, one x-row at a time, and
+// emits the lit ones. the octahedron only fills 1/6 of its box, so for every
+// z-layer and (y,z) row the span is narrowed with the L1 inequality first.
+// the bullet's stamp, if it has one, supplies the two fixed axes: for
+// x-movers it's the row's dyz, for y/z-movers a row is its stamp row plus
+// |dy| or |dz|. returns the number of cubes evaluated
+int sim_eval_bullet_box(const Sim *sim, int idx, BulletBox bbox,
+                        CubeEmitFn emit, void *user) {
+    const Grid *grid = &sim->grid;
+    const Bullets *bullets = &sim->bullets;
+    const BulletStamp *stamp = &bullets->stamps[idx];
+    // -1 without a stamp, rows are then plain field_eval_row() rows
+    int motion = stamp->l1 ? get_xyz(bullets->cold.directions[idx]) : -1;
+    Vector3 pos = bullet_cached_pos(bullets, idx);
+    Vector3 scale = bullet_scale(bullets, idx);
+    if (bbox.max_x <= bbox.min_x)
+        return 0;
+
+    float side_len[GRID_MAX_DIM];
+    uint64_t mask[FIELD_MASK_WORDS(GRID_MAX_DIM)];
+    FieldRow row = {
+        .bullet_x = pos.x,
+        .inv_sx = bullets->hot.inv_sx[idx],
+        .x0 = grid->min_center.x,
+        .step = grid->step,
+    };
+    float inv_sy = bullets->hot.inv_sy[idx];
+    float inv_sz = bullets->hot.inv_sz[idx];
+    int visited = 0;
+    for (int z = bbox.min_z; z < bbox.max_z; z++) {
+        float cz = grid->min_center.z + (float)z * grid->step;
+        float dz = fabsf((pos.z - cz) * inv_sz);
+        if (dz >= 1.0f && !sim->full_box)
+            continue;
+        int min_y = bbox.min_y, max_y = bbox.max_y;
+        if (!sim->full_box)
+            l1_span(pos.y, (1.0f - dz) * scale.y, grid->min_center.y,
+                    bbox.min_y, bbox.max_y, &min_y, &max_y);
+        for (int y = min_y; y < max_y; y++) {
+            float cy = grid->min_center.y + (float)y * grid->step;
+            float dy = fabsf((pos.y - cy) * inv_sy);
+            row.dyz = motion == 0 ? stamp->l1[(z - stamp->v0) * stamp->nu +
+                                              y - stamp->u0]
+                                  : dy + dz;
+            if (row.dyz >= 1.0f && !sim->full_box)
+                continue;
+            int min_x = bbox.min_x, max_x = bbox.max_x;
+            if (!sim->full_box)
+                l1_span(pos.x, (1.0f - row.dyz) * scale.x,
+                        grid->min_center.x, bbox.min_x, bbox.max_x, &min_x,
+                        &max_x);
+            int row_len = max_x - min_x;
+            if (row_len <= 0)
+                continue;
+            visited += row_len;
+
+            int lit;
+            if (motion <= 0) {
+                row.first = min_x;
+                lit = field_eval_row(&row, row_len, side_len, mask);
+            } else {
+                int v = motion == 1 ? z : y;
+                const float *l1 = stamp->l1 + (v - stamp->v0) * stamp->nu +
+                                  (min_x - stamp->u0);
+                lit = field_eval_stamp(l1, motion == 1 ? dy : dz, row_len,
+                                       side_len, mask);
+            }
+            if (!lit)
+                continue;
+            int row_idx = grid_idx(grid, min_x, y, z);
+            Vector3 cube_pos = {0.0f, cy, cz};
+            for (int w = 0; w < FIELD_MASK_WORDS(row_len); w++) {
+                for (uint64_t bits = mask[w]; bits; bits &= bits - 1) {
+                    int x = w * 64 + __builtin_ctzll(bits);
+                    cube_pos.x = row.x0 + (float)(min_x + x) * row.step;
+                    emit(user, row_idx + x, cube_pos, side_len[x],
+                         bullets->cold.colors[idx]);
+                }
+            }
+        }
+    }
+    return visited;
+}
+
+int sim_eval_bullet(const Sim *sim, int idx, CubeEmitFn emit, void *user) {
+    BulletBox bbox = get_bullet_bounding_box(
+        &sim->grid, bullet_cached_pos(&sim->bullets, idx),
+        bullet_scale(&sim->bullets, idx));
+    return sim_eval_bullet_box(sim, idx, bbox, emit, user);
+}
+
+/*
+
+Index Space -> World Space
+
+
+Octahedron equation: |x / scale_x| + |y / scale_y| + |z / scale_z| <= 1
+
+d = |(bul_x - cube_x) / scale_x| + |(bul_y - cube_y) / scale_y| + |(bul_z -
+cube_z) / scale_z|
+
+side_len = maxf(0.0f, CUBE_SIZE * (1 - d))
+
+*/
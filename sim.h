@@ -0,0 +1,358 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Headless simulation core: bullet pool, spawning and the octahedron field
+// math. No raylib dependency, so it can be benchmarked without a display.
+//
+// NOTE: raylib.h unconditionally typedefs its vector types, so when both are
+// used, include raylib.h *before* this header.
+
+#if !defined(RL_VECTOR3_TYPE)
+typedef struct Vector3 {
+    float x, y, z;
+} Vector3;
+#define RL_VECTOR3_TYPE
+#endif
+
+#if !defined(RL_VECTOR4_TYPE)
+typedef struct Vector4 {
+    float x, y, z, w;
+} Vector4;
+#define RL_VECTOR4_TYPE
+#endif
+
+#ifndef EPSILON
+#define EPSILON 0.000001f
+#endif
+
+// ----------- ~%~ macros ~%~ -----------
+
+#define CENTER ((Vector3){0.0f, 0.0f, 0.0f})
+
+// cube constants
+#define CUBE_SIZE 1.0f
+#define CUBE_PADDING 0.1f
+
+// default grid, override at runtime with CUBE_GRID=N or CUBE_GRID=XxYxZ
+#define DEFAULT_CUBES 25
+// longest row the field kernels handle
+#define GRID_MAX_DIM 1024
+
+// note: the grid length is the scaling factor for bullet speed, radius, etc.
+#define GETLENGTH(x) ((CUBE_SIZE + CUBE_PADDING) * (x) - CUBE_PADDING)
+
+// bullet constants
+#define DEFAULT_BULLET_CAP 32
+// every bullet color is a point on this gradient, see spawn_bullet()
+#define BULLET_COLOR_FROM                                                    \
+    ((Vector4){0xC7 / 255.0f, 0x51 / 255.0f, 0x08 / 255.0f, 1.0f})
+#define BULLET_COLOR_TO                                                      \
+    ((Vector4){0x61 / 255.0f, 0x0C / 255.0f, 0xCF / 255.0f, 1.0f})
+
+// we're good here, no scaling necessary
+static const float MIN_SPAWN_DELAY = 0.01f;
+static const float MAX_SPAWN_DELAY = 0.1f;
+
+// fixed-step simulation, see SimClock. CUBE_TICK_RATE overrides the rate
+#define DEFAULT_TICK_RATE 120
+// most ticks one sim_update() runs to catch up, the rest of a long frame is
+// dropped so a stall can't snowball into ever longer frames
+#define MAX_CATCHUP_TICKS 8
+
+// despawn timer wheel: DESPAWN_WHEEL_SLOTS slots of DESPAWN_WHEEL_TICK seconds
+// each, so one turn covers 8 s, about a bullet's longest life
+#define DESPAWN_WHEEL_SLOTS 256
+#define DESPAWN_WHEEL_TICK (1.0 / 32.0)
+// sim_skip() only replays the spawns of this last stretch of a jump, nothing
+// spawned before it is still alive at the end
+#define SKIP_SPAWN_WINDOW (DESPAWN_WHEEL_SLOTS * DESPAWN_WHEEL_TICK)
+
+// ----------- ~%~ structs ~%~ -----------
+
+enum Direction {
+    PX = 0x01,
+    NX = 0x02,
+    PY = 0x04,
+    NY = 0x08,
+    PZ = 0x10,
+    NZ = 0x20,
+    DIR_LEN = 6
+};
+
+// despawn deadlines hashed into DESPAWN_WHEEL_SLOTS buckets by tick, each an
+// intrusive doubly linked list through next/prev (indexed by bullet, -1 ends
+// a list). `cursor` is the first tick that hasn't fully expired yet
+typedef struct TimerWheel {
+    int head[DESPAWN_WHEEL_SLOTS];
+    int *next, *prev;
+    uint64_t cursor;
+} TimerWheel;
+
+// hot block, one float array per component so bullets_advance() can work
+// through BULLET_LANES bullets per iteration. every array is aligned to
+// BULLET_ALIGN and padded to a multiple of BULLET_LANES; dead bullets and the
+// padding sit at FLT_MAX with no velocity, so they never land in the grid.
+// px/py/pz hold the positions at Bullets.time, the rest is written at spawn
+#define BULLET_LANES 8
+#define BULLET_ALIGN 32
+
+typedef struct BulletsHot {
+    double *spawn_times;
+    float *px, *py, *pz;
+    float *x0, *y0, *z0; // start
+    float *vx, *vy, *vz;
+    float *sx, *sy, *sz; // scale
+    float *inv_sx, *inv_sy, *inv_sz;
+} BulletsHot;
+
+// cold block, only touched on spawn/despawn and by uploads
+typedef struct BulletsCold {
+    double *despawn_times;
+    Vector4 *colors;
+    float *speeds;
+    uint8_t *directions; // enum Direction
+} BulletsCold;
+
+// a bullet only ever moves along its motion axis, and it's spawned on cube
+// centers of the other two (u and v, in x/y/z order), so its cross-section
+// sits still. the stamp tabulates |du / scale.u| + |dv / scale.v| once at
+// spawn for every (u, v) cell its box covers, and a cube's L1 distance is
+// then the stamp entry plus the motion axis part. owned by the bullet slot,
+// freed by free_bullet(). only small cross-sections get one, so a pool of
+// large bullets doesn't hold a stamp each (at 256^3 they'd average ~18 KB,
+// for no measured gain): past STAMP_MAX_CELLS `l1` is NULL and its rows are
+// evaluated from scratch
+#define STAMP_MAX_CELLS 256
+typedef struct BulletStamp {
+    float *l1;  // nu * nv, u fastest
+    int u0, v0; // first cell on u and v
+    int nu, nv;
+} BulletStamp;
+
+// runtime-sized bullet pool, a sparse set: live[0, live_count) are the live
+// bullet indices, live[live_count, cap) the free ones, and slot_of[i] is where
+// bullet i sits in `live`. freeing swaps the bullet with the last live one, so
+// everything per-frame only walks live[0, live_count). the bitset answers
+// "is bullet i live" without touching the dense arrays.
+//
+// bullets fly in a straight line at a constant speed, so nothing is
+// integrated: a bullet is its spawn time, start position and velocity, and
+// bullet_pos() evaluates it at any time. the despawn time is worked out once
+// at spawn and handed to `despawn`. `version` changes on every spawn and
+// despawn, so tables built from the bullets only need rebuilding then.
+//
+// bullets_advance() caches every position at one time for the per-frame
+// passes, and sets the `in_grid` bit of each bullet that overlaps the grid
+typedef struct Bullets {
+    int cap, live_count;
+    int live_limit; // spawning stops at this many live bullets, <= cap
+    int padded; // cap rounded up to BULLET_LANES
+    int *live;
+    int *slot_of;
+    uint64_t *spawned;
+    uint64_t *in_grid;
+    unsigned version;
+    double time; // of the cached positions
+    BulletsHot hot;
+    BulletsCold cold;
+    BulletStamp *stamps;
+    TimerWheel despawn;
+    void *hot_block; // backs every hot array
+} Bullets;
+
+// runtime grid dimensions. cube positions are never stored, a cube's center
+// is derived from its index (see grid_cube_pos())
+typedef struct Grid {
+    int nx, ny, nz;
+    float step;         // CUBE_SIZE + CUBE_PADDING
+    Vector3 size;       // world extent, GETLENGTH() per axis
+    Vector3 min, max;   // world bounds
+    Vector3 min_center; // center of cube (0, 0, 0)
+} Grid;
+
+typedef struct BulletBox {
+    int min_x, max_x, min_y, max_y, min_z, max_z;
+} BulletBox;
+
+// one spawn_bullet() outcome, everything it draws from the rng, so spawns
+// can be recorded and replayed bit for bit (spawntrace.h). this is also the
+// trace's on-disk record, bump SPAWN_TRACE_VERSION when it changes
+typedef struct SpawnRecord {
+    double time;    // spawn time
+    float start[3]; // position at `time`
+    float scale[3];
+    float speed;
+    float color_t; // along BULLET_COLOR_FROM -> BULLET_COLOR_TO
+    uint8_t dir;   // one of the direction bits
+    uint8_t pad[7];
+} SpawnRecord;
+
+typedef struct SpawnWriter SpawnWriter;
+typedef struct SpawnReader SpawnReader;
+
+// everything one render loop needs to drive the animation
+typedef struct Sim {
+    Grid grid;
+    Bullets bullets;
+    double time; // seconds simulated, bullet positions are evaluated at it
+    float spawn_timer;
+    float spawn_delay_scale; // < 1 spawns faster, for load tests
+    float spawn_throttle;    // > 1 spawns slower, set by the governor
+    int bullet_count;  // live bullets after the last sim_step()
+    int visible_count; // of them, the ones overlapping the grid
+    int full_box; // debug: evaluate whole BulletBoxes, not just the L1 ball
+    SpawnWriter *record; // every spawn is written here
+    SpawnReader *replay; // spawns come from here instead of the rng
+} Sim;
+
+// Fixed-step driver for the render loops: frame time goes into an
+// accumulator and the sim runs whole ticks of `tick` seconds, so its state
+// only depends on the tick count, never on the frame rate. Rendering is one
+// tick behind and `alpha` of the way to the newest state: bullets move
+// linearly, so interpolating between the last two ticks is just evaluating
+// them at render_time (see sim_update()).
+typedef struct SimClock {
+    double tick;        // seconds per tick
+    double accumulator; // frame time not simulated yet, < tick between frames
+    double render_time; // sim time the bullets were last cached at
+    float alpha;        // accumulator / tick
+    int max_ticks;      // catch-up budget per sim_update()
+    long ticks;         // run so far
+    double dropped;     // seconds of frame time over budget, thrown away
+    double skipped;     // seconds sim_skip() jumped over without ticking
+} SimClock;
+
+// called for every cube a bullet lights up
+typedef void (*CubeEmitFn)(void *user, int cube_idx, Vector3 cube_pos,
+                           float side_len, Vector4 color);
+
+// ----------- ~%~ fn defs ~%~ -----------
+
+uint32_t next_rand();
+float next_randf(float min, float max);
+// nx <= 0 picks CUBE_GRID from the environment, or DEFAULT_CUBES per axis
+Grid grid_init(int nx, int ny, int nz);
+int is_out_of_bounds(const Grid *grid, Vector3 pos, Vector3 scale, int dir);
+BulletBox get_bullet_bounding_box(const Grid *grid, Vector3 pos,
+                                  Vector3 scale);
+void bullets_init(Bullets *bullets, int cap);
+void bullets_free(Bullets *bullets);
+void free_bullet(Bullets *bullets, int idx);
+// returns index if bullet is spawned, -1 if the pool is full or at
+// live_limit (and then nothing is drawn from the rng). the bullet starts
+// moving at `time`. `out`, if not NULL, gets what was rolled
+int spawn_bullet(const Grid *grid, Bullets *bullets, double time,
+                 SpawnRecord *out);
+// spawns exactly what `rec` describes, -1 if the pool is full or at
+// live_limit
+int spawn_bullet_replay(const Grid *grid, Bullets *bullets,
+                        const SpawnRecord *rec);
+// frees every bullet whose despawn time is <= time
+void expire_bullets(Bullets *bullets, double time);
+// caches every position at `time` and rebuilds `in_grid`, returns how many
+// bullets overlap the grid
+int bullets_advance(Bullets *bullets, const Grid *grid, double time);
+
+// bullet_cap <= 0 picks CUBE_BULLETS from the environment, or
+// DEFAULT_BULLET_CAP. CUBE_SPAWN_SCALE sets spawn_delay_scale.
+// CUBE_RECORD=path records every spawn to a spawn trace, CUBE_REPLAY=path
+// replays one instead of rolling spawns
+void sim_init(Sim *sim, Grid grid, int bullet_cap);
+void sim_free(Sim *sim);
+// one step of dt: spawns every bullet due within it at the exact time it's
+// due, expires the dead ones and caches positions at the new sim->time
+void sim_step(Sim *sim, float dt);
+// tick_rate <= 0 picks CUBE_TICK_RATE from the environment, or
+// DEFAULT_TICK_RATE
+SimClock sim_clock_init(int tick_rate);
+// adds frame_dt to the clock, runs the ticks that came due (at most
+// clock->max_ticks) and caches bullet positions at the interpolated
+// clock->render_time. returns the number of ticks run
+int sim_update(Sim *sim, SimClock *clock, float frame_dt);
+// catches up on `seconds` (an idle or paused window) in one go instead of
+// at most clock->max_ticks: bullets move linearly, so only the spawns and
+// despawns of the last SKIP_SPAWN_WINDOW are ticked through, everything
+// before that is jumped over (a replay skips its records). ends like
+// sim_update(). returns the number of ticks run
+int sim_skip(Sim *sim, SimClock *clock, double seconds);
+int sim_eval_bullet(const Sim *sim, int idx, CubeEmitFn emit, void *user);
+int sim_eval_bullet_box(const Sim *sim, int idx, BulletBox bbox,
+                        CubeEmitFn emit, void *user);
+
+static inline int grid_count(const Grid *grid) {
+    return grid->nx * grid->ny * grid->nz;
+}
+
+static inline int grid_idx(const Grid *grid, int x, int y, int z) {
+    return (z * grid->ny + y) * grid->nx + x;
+}
+
+static inline Vector3 grid_cube_pos(const Grid *grid, int x, int y, int z) {
+    return (Vector3){grid->min_center.x + (float)x * grid->step,
+                     grid->min_center.y + (float)y * grid->step,
+                     grid->min_center.z + (float)z * grid->step};
+}
+
+static inline Vector3 grid_cube_pos_idx(const Grid *grid, int cube_idx) {
+    int x = cube_idx % grid->nx;
+    int y = cube_idx / grid->nx % grid->ny;
+    int z = cube_idx / (grid->nx * grid->ny);
+    return grid_cube_pos(grid, x, y, z);
+}
+
+static inline int is_spawned(const Bullets *bullets, int idx) {
+    return (bullets->spawned[idx >> 6] >> (idx & 63)) & 1;
+}
+
+static inline int is_in_grid(const Bullets *bullets, int idx) {
+    return (bullets->in_grid[idx >> 6] >> (idx & 63)) & 1;
+}
+
+static inline Vector3 bullet_pos(const Bullets *bullets, int idx,
+                                 double time) {
+    const BulletsHot *h = &bullets->hot;
+    float t = (float)(time - h->spawn_times[idx]);
+    return (Vector3){h->x0[idx] + h->vx[idx] * t,
+                     h->y0[idx] + h->vy[idx] * t,
+                     h->z0[idx] + h->vz[idx] * t};
+}
+
+// the position cached by the last bullets_advance(), at bullets->time
+static inline Vector3 bullet_cached_pos(const Bullets *bullets, int idx) {
+    const BulletsHot *h = &bullets->hot;
+    return (Vector3){h->px[idx], h->py[idx], h->pz[idx]};
+}
+
+static inline Vector3 bullet_velocity(const Bullets *bullets, int idx) {
+    const BulletsHot *h = &bullets->hot;
+    return (Vector3){h->vx[idx], h->vy[idx], h->vz[idx]};
+}
+
+static inline Vector3 bullet_scale(const Bullets *bullets, int idx) {
+    const BulletsHot *h = &bullets->hot;
+    return (Vector3){h->sx[idx], h->sy[idx], h->sz[idx]};
+}
+
+static inline int get_xyz(int dir) {
+    return dir & (PX | NX) ? 0 : dir & (PY | NY) ? 1 : 2;
+}
+
+static inline float get_sign(int dir) {
+    return dir & (PX | PY | PZ) ? 1.0f : -1.0f;
+}
+
+// octahedron falloff, see the note at the bottom of sim.c
+static inline float cube_side_len(Vector3 bullet_pos, Vector3 scale,
+                                  Vector3 cube_pos) {
+    float dx = fabsf((bullet_pos.x - cube_pos.x) / scale.x);
+    float dy = fabsf((bullet_pos.y - cube_pos.y) / scale.y);
+    float dz = fabsf((bullet_pos.z - cube_pos.z) / scale.z);
+    float d = dx + dy + dz;
+    return fmaxf(0.0f, CUBE_SIZE * (1 - d));
+}
+
+#endif // SIM_H
@@ -0,0 +1,148 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//
+#include "spawntrace.h"
+
+// records are small, let stdio gather a good chunk of them per write
+#define WRITE_BUFFER (256 * 1024)
+
+struct SpawnWriter {
+    FILE *file;
+    char *buffer;
+    uint64_t count;
+    SpawnTraceHeader header;
+};
+
+struct SpawnReader {
+    void *map;
+    size_t map_len;
+    const SpawnRecord *next, *end;
+};
+
+SpawnWriter *spawn_writer_open(const char *path, const Grid *grid,
+                               int bullet_cap) {
+    SpawnWriter *w = calloc(1, sizeof(SpawnWriter));
+    if (w)
+        w->buffer = malloc(WRITE_BUFFER);
+    if (!w || !w->buffer) {
+        fprintf(stderr, "out of memory opening spawn trace\n");
+        exit(1);
+    }
+    w->file = fopen(path, "wb");
+    if (!w->file) {
+        perror(path);
+        exit(1);
+    }
+    setvbuf(w->file, w->buffer, _IOFBF, WRITE_BUFFER);
+    w->header = (SpawnTraceHeader){
+        .version = SPAWN_TRACE_VERSION,
+        .record_size = sizeof(SpawnRecord),
+        .nx = grid->nx,
+        .ny = grid->ny,
+        .nz = grid->nz,
+        .bullet_cap = bullet_cap,
+    };
+    memcpy(w->header.magic, SPAWN_TRACE_MAGIC, sizeof(w->header.magic));
+    if (fwrite(&w->header, sizeof(w->header), 1, w->file) != 1) {
+        perror(path);
+        exit(1);
+    }
+    return w;
+}
+
+void spawn_writer_push(SpawnWriter *w, const SpawnRecord *rec) {
+    if (fwrite(rec, sizeof(SpawnRecord), 1, w->file) != 1) {
+        perror("spawn trace");
+        exit(1);
+    }
+    w->count++;
+}
+
+void spawn_writer_close(SpawnWriter *w) {
+    if (!w)
+        return;
+    w->header.count = w->count;
+    if (fseek(w->file, 0, SEEK_SET) != 0 ||
+        fwrite(&w->header, sizeof(w->header), 1, w->file) != 1 ||
+        fclose(w->file) != 0)
+        perror("spawn trace");
+    free(w->buffer);
+    free(w);
+}
+
+SpawnReader *spawn_reader_open(const char *path, const Grid *grid) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        exit(1);
+    }
+    size_t len = (size_t)st.st_size;
+    if (len < sizeof(SpawnTraceHeader)) {
+        fprintf(stderr, "%s: not a spawn trace\n", path);
+        exit(1);
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    // read front to back, once
+    madvise(map, len, MADV_SEQUENTIAL);
+
+    const SpawnTraceHeader *h = map;
+    if (memcmp(h->magic, SPAWN_TRACE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != SPAWN_TRACE_VERSION ||
+        h->record_size != sizeof(SpawnRecord)) {
+        fprintf(stderr, "%s: not a version %d spawn trace\n", path,
+                SPAWN_TRACE_VERSION);
+        exit(1);
+    }
+    // positions are only valid in the grid they were rolled for
+    if (h->nx != grid->nx || h->ny != grid->ny || h->nz != grid->nz) {
+        fprintf(stderr, "%s: recorded on a %dx%dx%d grid, this one is "
+                "%dx%dx%d\n", path, h->nx, h->ny, h->nz, grid->nx,
+                grid->ny, grid->nz);
+        exit(1);
+    }
+    // an unclosed trace has no count, take every whole record
+    uint64_t count = (len - sizeof(SpawnTraceHeader)) / sizeof(SpawnRecord);
+    if (h->count && h->count < count)
+        count = h->count;
+
+    SpawnReader *r = malloc(sizeof(SpawnReader));
+    if (!r) {
+        fprintf(stderr, "out of memory opening spawn trace\n");
+        exit(1);
+    }
+    // the header is 40 bytes, records stay 8-aligned after it
+    r->map = map;
+    r->map_len = len;
+    r->next = (const SpawnRecord *)((const char *)map +
+                                    sizeof(SpawnTraceHeader));
+    r->end = r->next + count;
+    return r;
+}
+
+const SpawnRecord *spawn_reader_next(SpawnReader *r, double until) {
+    if (r->next == r->end || r->next->time > until)
+        return NULL;
+    return r->next++;
+}
+
+long spawn_reader_remaining(const SpawnReader *r) {
+    return (long)(r->end - r->next);
+}
+
+void spawn_reader_close(SpawnReader *r) {
+    if (!r)
+        return;
+    munmap(r->map, r->map_len);
+    free(r);
+}
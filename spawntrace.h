@@ -0,0 +1,46 @@
+#ifndef SPAWNTRACE_H
+#define SPAWNTRACE_H
+
+#include <stdint.h>
+//
+#include "sim.h"
+
+// Spawn traces: every spawn_bullet() outcome of a run, so the exact same
+// workload can be replayed against another renderer, kernel or build.
+//
+// A trace is a SpawnTraceHeader followed by SpawnRecords in spawn order, in
+// host byte order. Records are streamed out through a buffered FILE as they
+// happen, the count in the header is patched in on close (a trace cut short
+// by a crash is still read, up to its last whole record). Replay maps the
+// file and walks it in place, so long captures are paged in as they're used
+// rather than loaded up front.
+//
+// Replaying into the same grid with the same tick reproduces the recorded
+// run bit for bit: positions and despawns only depend on the records.
+
+#define SPAWN_TRACE_MAGIC "CUBESPWN"
+#define SPAWN_TRACE_VERSION 1
+
+typedef struct SpawnTraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size; // sizeof(SpawnRecord)
+    int32_t nx, ny, nz;   // grid the trace was recorded in
+    int32_t bullet_cap;   // of the recording, replays may differ
+    uint64_t count;       // records, 0 until the writer is closed
+} SpawnTraceHeader;
+
+// both exit with a message if the file can't be opened, and the reader if
+// it isn't a trace for `grid`
+SpawnWriter *spawn_writer_open(const char *path, const Grid *grid,
+                               int bullet_cap);
+void spawn_writer_push(SpawnWriter *writer, const SpawnRecord *rec);
+void spawn_writer_close(SpawnWriter *writer);
+
+SpawnReader *spawn_reader_open(const char *path, const Grid *grid);
+// the next record if it spawns at or before `until`, NULL otherwise
+const SpawnRecord *spawn_reader_next(SpawnReader *reader, double until);
+long spawn_reader_remaining(const SpawnReader *reader);
+void spawn_reader_close(SpawnReader *reader);
+
+#endif // SPAWNTRACE_H